@@ -5,47 +5,366 @@ using namespace std;
 template <typename T>
 class CombDigits {
 public:
-    const vector<T>& get(int c, int m) {
-        int key = (c << BASE_SHIFT) + m;
-
-        if (memo.count(key) == 0) {
-            vector<T> v;
-            if (m > 0) {
-                if (m == 1) {
-                    for (int i = 0; i < c; ++i) {
-                        v.push_back((T)1 << i);
-                    }
-                }
-                else if (c <= m) {
-                    v.push_back(((T)1 << c)-1);
-                }
-                else {
-                    const vector<T>& subZero = get(c - 1, m);
-                    v = subZero;
-                    const vector<T>& subOne = get(c - 1, m - 1);
-                    for (const T t: subOne) {
-                        v.push_back(((T)1 << (c-1)) | t);
-                    }
-                }
+    // masks are worked on as unsigned, at least 32 bits wide, so Gosper's hack never meets integer promotion
+    using U = conditional_t<sizeof(T) <= 4, uint32_t, uint64_t>;
+    static constexpr int DIGITS = numeric_limits<make_unsigned_t<T>>::digits;
+
+    /**
+     * The masks of get(c, m): a prefix of the column for m, kept alive for as long as the view is,
+     * even if the cache drops or regrows that column in the meantime.
+    */
+    class View {
+    public:
+        View(): count(0) {}
+        View(shared_ptr<const vector<T>> column, size_t count): column(std::move(column)), count(count) {}
+
+        const T* begin() const { return count == 0 ? nullptr : column->data(); }
+        const T* end() const { return begin() + count; }
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+        T operator[] (size_t i) const { return (*column)[i]; }
+
+    private:
+        shared_ptr<const vector<T>> column;
+        size_t count;
+    };
+
+    // max_bytes caps the masks the cache holds on to, least recently used columns go first
+    explicit CombDigits(size_t max_bytes = numeric_limits<size_t>::max()): max_bytes(max_bytes) {}
+
+    /**
+     * All masks of c bits with m of them set, ascending. get(c, m) is get(c - 1, m) followed by
+     * get(c - 1, m - 1) with bit c - 1 added, so every get(c, m) is the first C(c, m) masks of a single
+     * sequence per m. The cache keeps one column per m, grown with range() when a larger c asks for it,
+     * and every c shares it: a triangle of (c, m) results in DIGITS + 1 vectors.
+     * Lookups of what is cached already only take a shared lock, so threads can share one instance.
+     * m > c gives the one mask of c bits, m <= 0 nothing.
+    */
+    View get(int c, int m) {
+        assert(0 <= c && c <= DIGITS);
+        m = min(m, c);
+        if (m <= 0) return View();
+        size_t need = binom(c, m);
+        {
+            shared_lock<shared_mutex> read(lock);
+            Column &column = columns[m];
+            if (column.masks != nullptr && column.masks->size() >= need) {
+                column.used.store(++clock, memory_order_relaxed);
+                return View(column.masks, need);
             }
+        }
 
-            memo[key] = v;
+        unique_lock<shared_mutex> write(lock);
+        Column &column = columns[m];
+        if (column.masks == nullptr || column.masks->size() < need) {
+            auto grown = make_shared<vector<T>>();
+            grown->reserve(need);
+            if (column.masks != nullptr) {
+                grown->assign(column.masks->begin(), column.masks->end());
+                bytes -= column.masks->size() * sizeof(T);
+            }
+            for (T mask: range(c, m, grown->size())) grown->push_back(mask);
+            column.masks = std::move(grown);
+            bytes += need * sizeof(T);
         }
+        column.used.store(++clock, memory_order_relaxed);
+        View view(column.masks, need);
+        evict(m);
+        return view;
+    }
+
+    // bytes of masks the cache holds, views may keep dropped columns alive beyond that
+    size_t memory_bytes() const {
+        shared_lock<shared_mutex> read(lock);
+        return bytes;
+    }
 
-        return memo[key];
+    // C(n, k) for 0 <= k <= n <= 64, which all fit in 64 bits
+    static uint64_t binom(int n, int k) {
+        static const auto table = [] {
+            array<array<uint64_t, 65>, 65> t{};
+            for (int i = 0; i <= 64; ++i) {
+                t[i][0] = 1;
+                for (int j = 1; j <= i; ++j) t[i][j] = t[i - 1][j - 1] + t[i - 1][j];
+            }
+            return t;
+        }();
+        return k < 0 || k > n ? 0 : table[n][k];
     }
+
+    /**
+     * Ascending order is colexicographic order, so the position of a mask with bits p1 < p2 < ... < pm
+     * among all masks of m bits is C(p1, 1) + C(p2, 2) + ... + C(pm, m), whatever c is.
+    */
+    static uint64_t rank(T mask) {
+        U x = U(make_unsigned_t<T>(mask));
+        uint64_t r = 0;
+        for (int i = 1; x != 0; ++i, x &= x - 1) r += binom(__builtin_ctzll(x), i);
+        return r;
+    }
+
+    // the index-th mask of get(c, m), index < C(c, m): the highest bit is the largest p with C(p, m) <= index, and so on down
+    static T unrank(int c, int m, uint64_t index) {
+        assert(0 < m && m <= c && c <= DIGITS && index < binom(c, m));
+        U x = 0;
+        int p = c - 1;
+        for (int i = m; i > 0; --i, --p) {
+            while (binom(p, i) > index) --p;
+            index -= binom(p, i);
+            x |= U(1) << p;
+        }
+        return T(x);
+    }
+
+    /**
+     * Forward iterator over the masks of get(c, m) in the same order, one at a time and without memory:
+     * the next mask comes from Gosper's hack, which moves the lowest block of ones up by one and
+     * drops the rest of that block to the bottom.
+    */
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using difference_type   = std::ptrdiff_t;
+        using value_type        = T;
+        using pointer           = const T*;
+        using reference         = T;
+
+        Iterator(): x(0), index(0) {}
+        Iterator(U x, uint64_t index): x(x), index(index) {}
+
+        T operator* () const { return T(x); }
+        Iterator& operator++ () {
+            U low = x & (~x + 1);
+            U ripple = x + low;
+            // the block above low, shifted back down to bit 0 with one bit fewer
+            x = ripple | (((x ^ ripple) >> 2) >> __builtin_ctzll(low));
+            ++index;
+            return *this;
+        }
+        Iterator operator++ (int) {
+            Iterator tmp = *this;
+            ++*this;
+            return tmp;
+        }
+
+        // iterators of one range compare by position, the mask after the last one is never looked at
+        friend bool operator== (const Iterator &a, const Iterator &b) { return a.index == b.index; }
+        friend bool operator!= (const Iterator &a, const Iterator &b) { return a.index != b.index; }
+
+    private:
+        U x;
+        uint64_t index;
+    };
+
+    struct Range {
+        Iterator first, last;
+        Iterator begin() const { return first; }
+        Iterator end() const { return last; }
+        uint64_t size() const { return count; }
+        uint64_t count;
+    };
+
+    // masks [first, last) of get(c, m), by default all of them; m is capped at c like get() does
+    static Range range(int c, int m, uint64_t first = 0, uint64_t last = numeric_limits<uint64_t>::max()) {
+        assert(0 <= c && c <= DIGITS);
+        m = min(m, c);
+        last = min(last, m > 0 ? binom(c, m) : 0);
+        first = min(first, last);
+        U start = first < last ? U(make_unsigned_t<T>(unrank(c, m, first))) : 0;
+        return Range{Iterator(start, first), Iterator(0, last), last - first};
+    }
+
 private:
-    unordered_map<int, vector<T>> memo;
-    const int BASE_SHIFT = 8;
+    struct Column {
+        shared_ptr<const vector<T>> masks;
+        atomic<uint64_t> used{0};
+    };
+
+    // drop least recently used columns until the cap holds, the one for m last of all
+    void evict(int m) {
+        while (bytes > max_bytes) {
+            int oldest = m;
+            for (int i = 0; i <= DIGITS; ++i) {
+                if (i == m || columns[i].masks == nullptr) continue;
+                if (oldest == m || columns[i].used.load(memory_order_relaxed) < columns[oldest].used.load(memory_order_relaxed)) oldest = i;
+            }
+            bytes -= columns[oldest].masks->size() * sizeof(T);
+            columns[oldest].masks.reset();
+            if (oldest == m) break;
+        }
+    }
+
+    array<Column, DIGITS + 1> columns;
+    mutable shared_mutex lock;
+    atomic<uint64_t> clock{0};
+    size_t max_bytes, bytes = 0;
 };
 
-int main() {
+/**
+ * Runs fn(thread, mask) for every mask of CombDigits<T>::get(c, m) on `threads` threads.
+ * The C(c, m) positions are cut into chunks of `grain` masks, each chunk starting from unrank(), and
+ * every thread owns a contiguous run of chunks. A thread takes chunks from the front of its own run,
+ * and once that is empty steals the back half of another thread's run, so uneven fn costs even out.
+ * Masks within a chunk come in ascending order, chunks in no particular order.
+*/
+template <typename T, typename Fn>
+void parallel_comb_for_each(int c, int m, int threads, Fn fn, uint64_t grain = 1 << 14) {
+    uint64_t total = CombDigits<T>::range(c, m).size();
+    grain = max<uint64_t>(grain, 1);
+    uint64_t chunks = (total + grain - 1) / grain;
+    threads = int(max<uint64_t>(1, min<uint64_t>(max(threads, 1), chunks)));
+
+    // chunk indices [head, tail) still to do, padded so that two runs never share a cache line
+    struct alignas(64) Run {
+        mutex lock;
+        uint64_t head, tail;
+    };
+    vector<Run> runs(threads);
+    for (int t = 0; t < threads; ++t) {
+        runs[t].head = chunks * t / threads;
+        runs[t].tail = chunks * (t + 1) / threads;
+    }
+
+    auto work = [&](int t) {
+        Run &own = runs[t];
+        while (true) {
+            uint64_t chunk;
+            {
+                lock_guard<mutex> guard(own.lock);
+                chunk = own.head < own.tail ? own.head++ : chunks;
+            }
+            if (chunk == chunks) {
+                // steal the back half of the first run that still has chunks, give up once none has;
+                // the victim's lock is released before the stolen range goes into our own run, so no
+                // thread ever holds two run locks
+                uint64_t taken = 0;
+                for (int i = 1; i < threads && chunk == chunks; ++i) {
+                    Run &victim = runs[(t + i) % threads];
+                    lock_guard<mutex> guard(victim.lock);
+                    uint64_t left = victim.tail - victim.head;
+                    if (left == 0) continue;
+                    taken = (left + 1) / 2;
+                    victim.tail -= taken;
+                    chunk = victim.tail;
+                }
+                if (chunk == chunks) return;
+                lock_guard<mutex> guard(own.lock);
+                own.head = chunk + 1;
+                own.tail = chunk + taken;
+            }
+            for (T mask: CombDigits<T>::range(c, m, chunk * grain, (chunk + 1) * grain)) fn(t, mask);
+        }
+    };
+
+    vector<thread> workers;
+    for (int t = 1; t < threads; ++t) workers.emplace_back(work, t);
+    work(0);
+    for (thread &w: workers) w.join();
+}
+
+/**
+ * Folds every mask into one result: each thread accumulates with fn(acc, mask) into its own slot,
+ * starting from identity, and the slots are folded with combine at the end. Since chunks run in no
+ * fixed order, fn and combine have to give the same result for any order of the masks.
+*/
+template <typename T, typename R, typename Fn, typename Combine>
+R parallel_comb_reduce(int c, int m, int threads, R identity, Fn fn, Combine combine, uint64_t grain = 1 << 14) {
+    struct alignas(64) Slot { R acc; };
+    vector<Slot> slots(max(threads, 1), Slot{identity});
+    parallel_comb_for_each<T>(c, m, threads, [&](int t, T mask) { fn(slots[t].acc, mask); }, grain);
+    R result = identity;
+    for (Slot &slot: slots) result = combine(result, slot.acc);
+    return result;
+}
+
+namespace bench {
+
+using Clock = chrono::steady_clock;
+
+inline double elapsed_ms(Clock::time_point from) {
+    return chrono::duration<double, milli>(Clock::now() - from).count();
+}
+
+// masks/sec of a light per-mask reduction for 1, 2, 4, ... max_threads threads, checked against one thread
+template <typename T>
+void run_parallel(int c, int m, int max_threads) {
+    auto fn = [](uint64_t &acc, T mask) { acc += uint64_t(mask) * 0x9E3779B97F4A7C15ull >> 7; };
+    auto plus = [](uint64_t a, uint64_t b) { return a + b; };
+    uint64_t total = CombDigits<T>::range(c, m).size(), expected = 0;
+    for (int t = 1; ; t = min(t * 2, max_threads)) {
+        auto t0 = Clock::now();
+        uint64_t sum = parallel_comb_reduce<T>(c, m, t, uint64_t(0), fn, plus);
+        double ms = elapsed_ms(t0);
+        if (t == 1) expected = sum;
+        cout <<numeric_limits<T>::digits <<"-bit C(" <<c <<", " <<m <<")=" <<total <<" threads=" <<t
+             <<" " <<total / ms / 1000 <<" Mmasks/s" <<(sum == expected ? "" : " MISMATCH") <<endl;
+        if (t == max_threads) break;
+    }
+}
+
+// what the earlier memo, one vector per (c, m) the recursion reached, held for the same calls
+inline void legacy_memo(int c, int m, map<pair<int, int>, uint64_t> &memo) {
+    if (memo.count({c, m}) != 0) return;
+    uint64_t size = m <= 0 ? 0 : m == 1 ? c : c <= m ? 1 : 0;
+    if (m > 1 && c > m) {
+        legacy_memo(c - 1, m, memo);
+        legacy_memo(c - 1, m - 1, memo);
+        size = memo[{c - 1, m}] + memo[{c - 1, m - 1}];
+    }
+    memo[{c, m}] = size;
+}
+
+// bytes held for get(c, m) over all m, and for the middle m alone, against the per-(c, m) memo
+inline void run_memory(int c) {
+    auto report = [c](const string &what, int lo, int hi) {
+        CombDigits<uint32_t> digits;
+        map<pair<int, int>, uint64_t> memo;
+        uint64_t masks = 0;
+        for (int m = lo; m <= hi; ++m) {
+            masks += digits.get(c, m).size();
+            legacy_memo(c, m, memo);
+        }
+        uint64_t legacy = 0;
+        for (auto &entry: memo) legacy += entry.second;
+        legacy *= sizeof(uint32_t);
+        cout <<"c=" <<c <<" " <<what <<": " <<masks <<" masks, shared columns " <<digits.memory_bytes() / 1e6 <<"MB"
+             <<", per-(c, m) memo " <<legacy / 1e6 <<"MB in " <<memo.size() <<" vectors ("
+             <<double(legacy) / digits.memory_bytes() <<"x)" <<endl;
+    };
+    report("m=0.." + to_string(c), 0, c);
+    report("m=" + to_string(c / 2), c / 2, c / 2);
+}
+
+}  // namespace bench
+
+int main(int argc, char **argv) {
+    if (argc > 1 && string(argv[1]) == "memory") {
+        bench::run_memory(argc > 2 ? atoi(argv[2]) : 25);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "parallel") {
+        int c = argc > 2 ? atoi(argv[2]) : 30, m = argc > 3 ? atoi(argv[3]) : 15;
+        int max_threads = argc > 4 ? atoi(argv[4]) : max(1u, thread::hardware_concurrency());
+        bench::run_parallel<uint32_t>(min(c, 32), m, max(1, max_threads));
+        bench::run_parallel<uint64_t>(c, m, max(1, max_threads));
+        return 0;
+    }
+
+
     CombDigits<short> combDigits;
     for (int i = 0; i <= 5; ++i) {
-        const vector<short>& v = combDigits.get(5, i);
+        auto v = combDigits.get(5, i);
         copy(v.begin(), v.end(), ostream_iterator<short>(cout, " "));
         cout <<endl;
     }
+
+    // the same masks lazily, and straight to any position
+    for (short mask: CombDigits<short>::range(5, 3)) cout <<mask <<"@" <<CombDigits<short>::rank(mask) <<" ";
+    cout <<endl;
+    cout <<CombDigits<short>::unrank(5, 3, 6) <<endl;
+    long long total = 0;
+    for (uint64_t mask: CombDigits<uint64_t>::range(64, 62)) total += __builtin_popcountll(mask);
+    cout <<total <<endl;
     /**
      * return: 7 11 13 14 19 21 22 25 26 28
      * 7: 00111
@@ -1,11 +1,25 @@
 #include <limits>
 #include <type_traits>
 #include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <cstdint>
+#include <cstddef>
+#if __cplusplus >= 202002L
+#include <bit>
+#endif
+#if defined(__x86_64__) && defined(__GNUC__)
+#define HIGH_BIT_X86 1
+#include <immintrin.h>
+#endif
 
 using namespace std;
 
-template <typename T> int high_bit(T x) {
-    auto ux = make_unsigned_t<T>(x);
+// the binary search over bit positions, for compilers without the builtins below
+template <typename T> constexpr int high_bit_loop(T x) {
+    auto ux = static_cast<make_unsigned_t<T>>(x);
     int lb = -1, rb = numeric_limits<decltype(ux)>::digits;
     while (lb + 1 < rb) {
         int mid = (lb + rb) / 2;
@@ -19,10 +33,386 @@ template <typename T> int high_bit(T x) {
     return lb;
 }
 
-int main() {
+/*
+    index of the highest set bit, -1 for 0; negative x counts as its unsigned value
+    lowers to a single lzcnt / bsr: digits - 1 - count of leading zeros
+*/
+template <typename T> constexpr int high_bit(T x) {
+    using U = make_unsigned_t<T>;
+    auto ux = static_cast<U>(x);
+    constexpr int digits = numeric_limits<U>::digits;
+#if __cplusplus >= 202002L
+    return digits - 1 - countl_zero(ux);
+#elif defined(__GNUC__)
+    if (ux == 0) return -1;
+    if constexpr (digits <= 32) return 31 - __builtin_clz(ux);
+    else return 63 - __builtin_clzll(ux);
+#else
+    return high_bit_loop(x);
+#endif
+}
+
+// index of the lowest set bit, -1 for 0
+template <typename T> constexpr int low_bit(T x) {
+    using U = make_unsigned_t<T>;
+    auto ux = static_cast<U>(x);
+#if __cplusplus >= 202002L
+    return ux == 0 ? -1 : countr_zero(ux);
+#elif defined(__GNUC__)
+    if (ux == 0) return -1;
+    if constexpr (numeric_limits<U>::digits <= 32) return __builtin_ctz(ux);
+    else return __builtin_ctzll(ux);
+#else
+    return high_bit_loop(static_cast<U>(ux & (~ux + 1)));
+#endif
+}
+
+template <typename T> constexpr int popcount(T x) {
+    using U = make_unsigned_t<T>;
+    auto ux = static_cast<U>(x);
+#if __cplusplus >= 202002L
+    return std::popcount(ux);
+#elif defined(__GNUC__)
+    if constexpr (numeric_limits<U>::digits <= 32) return __builtin_popcount(ux);
+    else return __builtin_popcountll(ux);
+#else
+    int n = 0;
+    for (; ux != 0; ux &= ux - 1) ++n;
+    return n;
+#endif
+}
+
+// smallest power of two >= x as unsigned, 1 for 0 and 1, 0 when it does not fit
+template <typename T> constexpr T next_pow2(T x) {
+    using U = make_unsigned_t<T>;
+    auto ux = static_cast<U>(x);
+    if (ux <= 1) return T(1);
+    int shift = high_bit(static_cast<U>(ux - 1)) + 1;
+    return shift == numeric_limits<U>::digits ? T(0) : static_cast<T>(U(1) << shift);
+}
+
+static_assert(high_bit(0) == -1 && high_bit(1) == 0 && high_bit(34) == 5 && high_bit(-1) == 31);
+static_assert(low_bit(0) == -1 && low_bit(40) == 3 && ::popcount(255u) == 8 && ::popcount(-1ll) == 64);
+static_assert(next_pow2(0) == 1 && next_pow2(5u) == 8u && next_pow2(64) == 64 && next_pow2(0x80000001u) == 0u);
+
+/*
+    Batch versions over arrays of 32- or 64-bit integers, 8 / 4 lanes at a time with AVX2 and 16 / 8 with
+    AVX-512 (F + CD for the leading-zero count, VPOPCNTDQ for popcount), picked at run time; other widths,
+    other CPUs and the tail go through the scalar functions above.
+    AVX2 has no leading-zero count, so a 32-bit lane goes through float: x & ~(x >> 1) keeps the top bit
+    and clears the one below it, so rounding to 24 bits can never carry into the next power of two, and
+    the exponent field is the bit index. Lanes with bit 31 set convert as negative and are patched to 31,
+    a 64-bit lane is its high half's result + 32, or its low half's when the high half is 0.
+*/
+enum class SimdLevel { SCALAR, AVX2, AVX512 };
+
+inline SimdLevel simd_level() {
+#ifdef HIGH_BIT_X86
+    static const SimdLevel level = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512cd") ? SimdLevel::AVX512
+        : __builtin_cpu_supports("avx2") ? SimdLevel::AVX2 : SimdLevel::SCALAR;
+    return level;
+#else
+    return SimdLevel::SCALAR;
+#endif
+}
+
+enum class BitOp { HIGH_BIT, LOW_BIT, POPCOUNT, NEXT_POW2 };
+
+#ifdef HIGH_BIT_X86
+// GCC 12 flags the undefined-vector placeholders inside its own AVX-512 intrinsics when they are inlined here
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+namespace simd {
+
+inline bool has_avx512_popcount() {
+    static const bool yes = simd_level() == SimdLevel::AVX512 && __builtin_cpu_supports("avx512vpopcntdq");
+    return yes;
+}
+
+__attribute__((target("avx2")))
+inline __m256i high_bit8(__m256i x) {
+    __m256 f = _mm256_cvtepi32_ps(_mm256_andnot_si256(_mm256_srli_epi32(x, 1), x));
+    __m256i e = _mm256_sub_epi32(_mm256_srli_epi32(_mm256_castps_si256(f), 23), _mm256_set1_epi32(127));
+    e = _mm256_max_epi32(e, _mm256_set1_epi32(-1));
+    __m256i top = _mm256_srai_epi32(x, 31);
+    return _mm256_or_si256(_mm256_and_si256(top, _mm256_set1_epi32(31)), _mm256_andnot_si256(top, e));
+}
+
+// per 64-bit lane, as an int32 in the low half
+__attribute__((target("avx2")))
+inline __m256i high_bit4(__m256i x) {
+    __m256i h = high_bit8(x);
+    __m256i hi = _mm256_srli_epi64(h, 32), lo = _mm256_and_si256(h, _mm256_set1_epi64x(0xFFFFFFFF));
+    __m256i hi_zero = _mm256_cmpeq_epi64(hi, _mm256_set1_epi64x(0xFFFFFFFF));
+    return _mm256_blendv_epi8(_mm256_add_epi32(hi, _mm256_set1_epi64x(32)), lo, hi_zero);
+}
+
+// bytes holding the popcount of each input byte
+__attribute__((target("avx2")))
+inline __m256i popcount_bytes(__m256i x) {
+    const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                           0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low = _mm256_set1_epi8(0x0F);
+    return _mm256_add_epi8(_mm256_shuffle_epi8(table, _mm256_and_si256(x, low)),
+                           _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(x, 4), low)));
+}
+
+// low halves of the four 64-bit lanes as four int32
+__attribute__((target("avx2")))
+inline __m128i pack_low4(__m256i x) {
+    return _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(x, _mm256_setr_epi32(0, 2, 4, 6, 0, 0, 0, 0)));
+}
+
+template <BitOp OP, typename Out>
+__attribute__((target("avx2")))
+size_t run32_avx2(const uint32_t *in, Out *out, size_t n) {
+    const __m256i one = _mm256_set1_epi32(1);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(in + i)), r;
+        if constexpr (OP == BitOp::HIGH_BIT) {
+            r = high_bit8(x);
+        }
+        else if constexpr (OP == BitOp::LOW_BIT) {
+            r = high_bit8(_mm256_and_si256(x, _mm256_sub_epi32(_mm256_setzero_si256(), x)));
+        }
+        else if constexpr (OP == BitOp::POPCOUNT) {
+            __m256i pairs = _mm256_maddubs_epi16(popcount_bytes(x), _mm256_set1_epi8(1));
+            r = _mm256_madd_epi16(pairs, _mm256_set1_epi16(1));
+        }
+        else {
+            // 1 << (high_bit(x - 1) + 1), a shift by 32 gives 0; x = 0 would wrap, it gets 1
+            __m256i shift = _mm256_add_epi32(high_bit8(_mm256_sub_epi32(x, one)), one);
+            r = _mm256_sllv_epi32(one, shift);
+            r = _mm256_blendv_epi8(r, one, _mm256_cmpeq_epi32(x, _mm256_setzero_si256()));
+        }
+        _mm256_storeu_si256((__m256i*)(out + i), r);
+    }
+    return i;
+}
+
+template <BitOp OP, typename Out>
+__attribute__((target("avx2")))
+size_t run64_avx2(const uint64_t *in, Out *out, size_t n) {
+    const __m256i one = _mm256_set1_epi64x(1);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(in + i));
+        if constexpr (OP == BitOp::NEXT_POW2) {
+            // the bit index sits in the low half with a zero high half, so -1 + 1 wraps to a shift by 0 in 32 bits
+            __m256i shift = _mm256_add_epi32(high_bit4(_mm256_sub_epi64(x, one)), one);
+            __m256i r = _mm256_sllv_epi64(one, shift);
+            r = _mm256_blendv_epi8(r, one, _mm256_cmpeq_epi64(x, _mm256_setzero_si256()));
+            _mm256_storeu_si256((__m256i*)(out + i), r);
+            continue;
+        }
+        __m256i r;
+        if constexpr (OP == BitOp::HIGH_BIT) {
+            r = high_bit4(x);
+        }
+        else if constexpr (OP == BitOp::LOW_BIT) {
+            r = high_bit4(_mm256_and_si256(x, _mm256_sub_epi64(_mm256_setzero_si256(), x)));
+        }
+        else {
+            r = _mm256_sad_epu8(popcount_bytes(x), _mm256_setzero_si256());
+        }
+        _mm_storeu_si128((__m128i*)(out + i), pack_low4(r));
+    }
+    return i;
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq")))
+inline size_t popcount32_avx512(const uint32_t *in, int *out, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) _mm512_storeu_si512(out + i, _mm512_popcnt_epi32(_mm512_loadu_si512(in + i)));
+    return i;
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq")))
+inline size_t popcount64_avx512(const uint64_t *in, int *out, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) _mm256_storeu_si256((__m256i*)(out + i), _mm512_cvtepi64_epi32(_mm512_popcnt_epi64(_mm512_loadu_si512(in + i))));
+    return i;
+}
+
+template <BitOp OP, typename Out>
+__attribute__((target("avx512f,avx512cd")))
+size_t run32_avx512(const uint32_t *in, Out *out, size_t n) {
+    const __m512i one = _mm512_set1_epi32(1), top = _mm512_set1_epi32(31);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i x = _mm512_loadu_si512(in + i), r;
+        if constexpr (OP == BitOp::HIGH_BIT) {
+            r = _mm512_sub_epi32(top, _mm512_lzcnt_epi32(x));
+        }
+        else if constexpr (OP == BitOp::LOW_BIT) {
+            r = _mm512_sub_epi32(top, _mm512_lzcnt_epi32(_mm512_and_si512(x, _mm512_sub_epi32(_mm512_setzero_si512(), x))));
+        }
+        else {
+            __m512i shift = _mm512_sub_epi32(_mm512_set1_epi32(32), _mm512_lzcnt_epi32(_mm512_sub_epi32(x, one)));
+            r = _mm512_mask_mov_epi32(_mm512_sllv_epi32(one, shift), _mm512_testn_epi32_mask(x, x), one);
+        }
+        _mm512_storeu_si512(out + i, r);
+    }
+    return i;
+}
+
+template <BitOp OP, typename Out>
+__attribute__((target("avx512f,avx512cd")))
+size_t run64_avx512(const uint64_t *in, Out *out, size_t n) {
+    const __m512i one = _mm512_set1_epi64(1), top = _mm512_set1_epi64(63);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m512i x = _mm512_loadu_si512(in + i), r;
+        if constexpr (OP == BitOp::NEXT_POW2) {
+            __m512i shift = _mm512_sub_epi64(_mm512_set1_epi64(64), _mm512_lzcnt_epi64(_mm512_sub_epi64(x, one)));
+            r = _mm512_mask_mov_epi64(_mm512_sllv_epi64(one, shift), _mm512_testn_epi64_mask(x, x), one);
+            _mm512_storeu_si512(out + i, r);
+            continue;
+        }
+        if constexpr (OP == BitOp::HIGH_BIT) {
+            r = _mm512_sub_epi64(top, _mm512_lzcnt_epi64(x));
+        }
+        else {
+            r = _mm512_sub_epi64(top, _mm512_lzcnt_epi64(_mm512_and_si512(x, _mm512_sub_epi64(_mm512_setzero_si512(), x))));
+        }
+        _mm256_storeu_si256((__m256i*)(out + i), _mm512_cvtepi64_epi32(r));
+    }
+    return i;
+}
+
+}  // namespace simd
+#pragma GCC diagnostic pop
+#endif
+
+template <BitOp OP, typename T, typename Out>
+void bit_batch(const T *in, Out *out, size_t n, SimdLevel level) {
+    size_t done = 0;
+#ifdef HIGH_BIT_X86
+    level = min(level, simd_level());
+    if (OP == BitOp::POPCOUNT && level == SimdLevel::AVX512 && !simd::has_avx512_popcount()) level = SimdLevel::AVX2;
+    if constexpr (sizeof(T) == 4 && OP == BitOp::POPCOUNT) {
+        if (level == SimdLevel::AVX512) done = simd::popcount32_avx512((const uint32_t*)in, out, n);
+        else if (level == SimdLevel::AVX2) done = simd::run32_avx2<OP>((const uint32_t*)in, out, n);
+    }
+    else if constexpr (sizeof(T) == 8 && OP == BitOp::POPCOUNT) {
+        if (level == SimdLevel::AVX512) done = simd::popcount64_avx512((const uint64_t*)in, out, n);
+        else if (level == SimdLevel::AVX2) done = simd::run64_avx2<OP>((const uint64_t*)in, out, n);
+    }
+    else if constexpr (sizeof(T) == 4) {
+        if (level == SimdLevel::AVX512) done = simd::run32_avx512<OP>((const uint32_t*)in, out, n);
+        else if (level == SimdLevel::AVX2) done = simd::run32_avx2<OP>((const uint32_t*)in, out, n);
+    }
+    else if constexpr (sizeof(T) == 8) {
+        if (level == SimdLevel::AVX512) done = simd::run64_avx512<OP>((const uint64_t*)in, out, n);
+        else if (level == SimdLevel::AVX2) done = simd::run64_avx2<OP>((const uint64_t*)in, out, n);
+    }
+#endif
+    for (size_t i = done; i < n; ++i) {
+        if constexpr (OP == BitOp::HIGH_BIT) out[i] = high_bit(in[i]);
+        else if constexpr (OP == BitOp::LOW_BIT) out[i] = low_bit(in[i]);
+        else if constexpr (OP == BitOp::POPCOUNT) out[i] = ::popcount(in[i]);
+        else out[i] = next_pow2(in[i]);
+    }
+}
+
+template <typename T> void high_bit_batch(const T *in, int *out, size_t n, SimdLevel level = simd_level()) {
+    bit_batch<BitOp::HIGH_BIT>(in, out, n, level);
+}
+
+template <typename T> void low_bit_batch(const T *in, int *out, size_t n, SimdLevel level = simd_level()) {
+    bit_batch<BitOp::LOW_BIT>(in, out, n, level);
+}
+
+template <typename T> void popcount_batch(const T *in, int *out, size_t n, SimdLevel level = simd_level()) {
+    bit_batch<BitOp::POPCOUNT>(in, out, n, level);
+}
+
+template <typename T> void next_pow2_batch(const T *in, T *out, size_t n, SimdLevel level = simd_level()) {
+    bit_batch<BitOp::NEXT_POW2>(in, out, n, level);
+}
+
+namespace bench {
+
+using Clock = chrono::steady_clock;
+
+inline double elapsed_ms(Clock::time_point from) {
+    return chrono::duration<double, milli>(Clock::now() - from).count();
+}
+
+// ns per element of the old loop, the builtin and each batch level, checked against the loop
+template <typename T>
+void run_width(int n) {
+    mt19937_64 rng(20240601);
+    vector<T> in(n);
+    // every bit length equally often, plus zeros; signed T gets negative values from the top bit
+    for (T &x: in) {
+        int shift = rng() % 65;
+        x = T(shift == 64 ? 0 : rng() >> shift);
+    }
+    vector<int> expected(n), out(n);
+    auto ns = [n](double ms) { return ms * 1e6 / n; };
+
+    auto t0 = Clock::now();
+    for (int i = 0; i < n; ++i) expected[i] = high_bit_loop(in[i]);
+    double loop = elapsed_ms(t0);
+    t0 = Clock::now();
+    for (int i = 0; i < n; ++i) out[i] = high_bit(in[i]);
+    double builtin = elapsed_ms(t0);
+    cout <<numeric_limits<make_unsigned_t<T>>::digits <<"-bit" <<(is_signed_v<T> ? " signed" : "") <<" n=" <<n <<" (ns/element)" <<(out == expected ? "" : " MISMATCH") <<endl
+         <<"  high_bit loop    " <<ns(loop) <<endl
+         <<"  high_bit builtin " <<ns(builtin) <<endl;
+
+    vector<int> low(n), pop(n);
+    vector<T> pow2(n), pow2_out(n);
+    for (int i = 0; i < n; ++i) {
+        low[i] = low_bit(in[i]);
+        pop[i] = ::popcount(in[i]);
+        pow2[i] = next_pow2(in[i]);
+    }
+    const pair<SimdLevel, string> levels[] = {{SimdLevel::SCALAR, "scalar"}, {SimdLevel::AVX2, "avx2  "}, {SimdLevel::AVX512, "avx512"}};
+    for (auto &[level, name]: levels) {
+        if (level > simd_level()) continue;
+        t0 = Clock::now();
+        high_bit_batch(in.data(), out.data(), n, level);
+        double h = elapsed_ms(t0);
+        bool same = out == expected;
+        t0 = Clock::now();
+        low_bit_batch(in.data(), out.data(), n, level);
+        double l = elapsed_ms(t0);
+        same = same && out == low;
+        t0 = Clock::now();
+        popcount_batch(in.data(), out.data(), n, level);
+        double p = elapsed_ms(t0);
+        same = same && out == pop;
+        t0 = Clock::now();
+        next_pow2_batch(in.data(), pow2_out.data(), n, level);
+        double np = elapsed_ms(t0);
+        same = same && pow2_out == pow2;
+        cout <<"  batch " <<name <<" high=" <<ns(h) <<" low=" <<ns(l) <<" popcount=" <<ns(p) <<" next_pow2=" <<ns(np)
+             <<(same ? "" : " MISMATCH") <<endl;
+    }
+}
+
+inline void run(int n) {
+    run_width<uint32_t>(n);
+    run_width<uint64_t>(n);
+    // the batch kernels read signed arrays as unsigned lanes
+    run_width<int32_t>(n);
+    run_width<int64_t>(n);
+}
+
+}  // namespace bench
+
+int main(int argc, char **argv) {
+    if (argc > 1 && string(argv[1]) == "bench") {
+        bench::run(argc > 2 ? atoi(argv[2]) : 1 << 22);
+        return 0;
+    }
+
     cout <<high_bit(0) <<endl;
     cout <<high_bit(1) <<endl;
     cout <<high_bit(7) <<endl;
     cout <<high_bit(8) <<endl;
     cout <<high_bit(34) <<endl;
-}
\ No newline at end of file
+}
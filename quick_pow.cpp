@@ -1,29 +1,1045 @@
 #include <bits/stdc++.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+#define POW_MOD_X86 1
+#include <immintrin.h>
+#endif
 
 using namespace std;
 
+// unsigned type twice as wide as T, holds any product of two values below the modulus
+template <typename T> struct Wider;
+template <> struct Wider<uint32_t> { using type = uint64_t; };
+template <> struct Wider<uint64_t> { using type = unsigned __int128; };
+template <typename T> using wider_t = typename Wider<T>::type;
+
+/*
+    a * b % p without overflow for 0 <= a, b < p: the product goes through the next wider type,
+    128-bit only when a 64-bit p actually exceeds 2^32
+*/
+template <typename T>
+inline T mul_mod(const T a, const T b, const T p) {
+    using U = make_unsigned_t<T>;
+    if constexpr (sizeof(T) <= 4) {
+        return T(uint64_t(U(a)) * U(b) % U(p));
+    }
+    else {
+        if ((U(p) >> 32) == 0) return T(U(a) * U(b) % U(p));
+        return T((unsigned __int128)U(a) * U(b) % U(p));
+    }
+}
+
 /*
     pow(m, n) % p
     suppose n = 13 (1101), that means pow(m, n) = pow(m, 0x1) * pow(m, 0x100) * pow(m, 0x1000)
 */
-template <typename T> 
+template <typename T>
 inline T pow_mod(const T m, T n, const T p) {
-    T ans = 1;
+    T ans = 1 % p;
     T cur = m % p;
+    if (cur < 0) cur += p;
     while (n > 0) {
         if (n & 1) {
-            ans = (ans * cur) % p;
+            ans = mul_mod(ans, cur, p);
         }
-        cur = cur * cur % p;
+        cur = mul_mod(cur, cur, p);
         n >>= 1;
     }
     return ans;
 }
 
-int main() {
+/*
+    Montgomery form modulo an odd p < 2^w (w = 32 or 64): a is kept as a * 2^w mod p, so a product
+    reduces with two multiplications and a shift instead of a divide.
+    reduce(t) = t / 2^w mod p: q = t * p^-1 mod 2^w makes t - q * p divisible by 2^w, and as the low
+    halves cancel, (t - q * p) / 2^w = hi(t) - hi(q * p), which lies in (-p, p) for any t < p * 2^w.
+*/
+template <typename T>
+class Montgomery {
+public:
+    using value_type = T;
+    using Wide = wider_t<T>;
+    static constexpr int BITS = numeric_limits<T>::digits;
+
+    explicit Montgomery(T p): p(p) {
+        assert(p & 1);
+        // Newton's iteration doubles the correct low bits of p^-1 mod 2^w, p * p == 1 mod 8 to start
+        inv = p;
+        for (int i = 0; i < 5; ++i) inv *= 2 - p * inv;
+        r1 = T(-p) % p;
+        r2 = T(Wide(r1) * r1 % p);
+    }
+
+    T modulus() const { return p; }
+    T one() const { return r1; }
+    // p^-1 mod 2^w and 2^2w mod p, for code that reduces in its own registers
+    T inverse() const { return inv; }
+    T r_squared() const { return r2; }
+    T to(T a) const { return reduce(Wide(a % p) * r2); }
+    T from(T a) const { return reduce(a); }
+    T mul(T a, T b) const { return reduce(Wide(a) * b); }
+
+    T reduce(Wide t) const {
+        T q = T(t) * inv;
+        T hi = T(t >> BITS), qp = T((Wide(q) * p) >> BITS);
+        return hi >= qp ? hi - qp : hi - qp + p;
+    }
+
+private:
+    T p, inv, r1, r2;
+};
+
+/*
+    Barrett reduction modulo any p >= 1.
+    32-bit p: mu = floor((2^64 - 1) / p) is computed once, then x mod p = x - floor(x * mu / 2^64) * p,
+    off by at most 2 * p, for every x < 2^64.
+    64-bit p: a full 128 x 128-bit quotient costs more than the hardware divide it replaces, so this is the
+    Moller-Granlund division by an invariant: p shifted until its top bit is set, d, and the 64-bit
+    reciprocal v = floor((2^128 - 1) / d) - 2^64. One 64 x 64 -> 128 multiply and one low multiply give
+    the remainder after at most two corrections, for every x < p * 2^64, which covers any product a * b
+    of reduced a and b.
+*/
+template <typename T>
+class Barrett {
+public:
+    using value_type = T;
+    using Wide = wider_t<T>;
+    static constexpr int BITS = numeric_limits<T>::digits;
+
+    explicit Barrett(T p): p(p) {
+        assert(p >= 1);
+        if constexpr (BITS == 32) {
+            mu = Wide(~Wide(0)) / p;
+        }
+        else {
+            shift = __builtin_clzll(p);
+            d = p << shift;
+            v = uint64_t(~(unsigned __int128)0 / d);
+        }
+    }
+
+    T modulus() const { return p; }
+    T one() const { return 1 % p; }
+    T to(T a) const { return a % p; }
+    T from(T a) const { return a; }
+    T mul(T a, T b) const { return reduce(Wide(a) * b); }
+
+    T reduce(Wide x) const {
+        if constexpr (BITS == 32) {
+            Wide r = x - Wide(((unsigned __int128)x * mu) >> 64) * p;
+            while (r >= p) r -= p;
+            return T(r);
+        }
+        else {
+            // x * 2^shift < d * 2^64, so the high word u1 is below d
+            Wide u = x << shift;
+            uint64_t u1 = uint64_t(u >> 64), u0 = uint64_t(u);
+            Wide q = Wide(v) * u1 + ((Wide(u1 + 1) << 64) | u0);
+            uint64_t q0 = uint64_t(q), r = u0 - uint64_t(q >> 64) * d;
+            if (r > q0) r += d;
+            if (r >= d) r -= d;
+            return r >> shift;
+        }
+    }
+
+private:
+    T p;
+    Wide mu = 0;
+    uint64_t d = 0, v = 0;
+    int shift = 0;
+};
+
+/*
+    pow(m, n) % p with the reductions of a Montgomery or Barrett modulus, the same square-and-multiply
+    as above but without a divide per step
+*/
+template <typename Mod, typename E>
+inline typename Mod::value_type pow_mod(const typename Mod::value_type m, E n, const Mod &mod) {
+    using T = typename Mod::value_type;
+    T ans = mod.one();
+    T cur = mod.to(m);
+    while (n > 0) {
+        if (n & 1) {
+            ans = mod.mul(ans, cur);
+        }
+        cur = mod.mul(cur, cur);
+        n >>= 1;
+    }
+    return mod.from(ans);
+}
+
+/*
+    Left-to-right sliding window of up to w bits: precompute m^1, m^3, ..., m^(2^w - 1), then each window
+    of the exponent costs its squarings and one multiplication, about bits / (w + 1) multiplications
+    instead of bits / 2.
+*/
+template <typename Mod, typename E>
+inline typename Mod::value_type pow_mod_window(const typename Mod::value_type m, E n, const Mod &mod, int w = 4) {
+    using T = typename Mod::value_type;
+    assert(1 <= w && w <= 8);
+    T odd[1 << 7];
+    odd[0] = mod.to(m);
+    T square = mod.mul(odd[0], odd[0]);
+    for (int i = 1; i < (1 << (w - 1)); ++i) odd[i] = mod.mul(odd[i - 1], square);
+
+    T ans = mod.one();
+    int i = numeric_limits<E>::digits - 1;
+    while (i >= 0 && !((n >> i) & 1)) --i;
+    while (i >= 0) {
+        if (!((n >> i) & 1)) {
+            ans = mod.mul(ans, ans);
+            --i;
+            continue;
+        }
+        // the longest window n[i..j] of at most w bits that ends with a 1
+        int j = max(i - w + 1, 0);
+        while (!((n >> j) & 1)) ++j;
+        unsigned bits = unsigned((n >> j) & ((E(1) << (i - j + 1)) - 1));
+        for (int k = j; k <= i; ++k) ans = mod.mul(ans, ans);
+        ans = mod.mul(ans, odd[bits >> 1]);
+        i = j - 1;
+    }
+    return mod.from(ans);
+}
+
+/*
+    Batch exponentiation with one shared modulus. Montgomery<uint32_t> with p < 2^31 runs 8 (AVX2) or
+    16 (AVX-512F) exponentiations side by side, one per 32-bit lane, picked at run time from what the CPU
+    supports; every lane squares each round and multiplies where its own exponent bit is set, until all
+    exponents in the vector are used up. Other moduli, and the elements past the last full vector, go
+    through the scalar pow_mod.
+    The lane product uses the same reduction as Montgomery::reduce: hi(t) - hi(q * p), and p < 2^31 lets
+    min(d, d + p) as unsigned 32-bit pick the value in [0, p) without a compare.
+*/
+enum class SimdLevel { SCALAR, AVX2, AVX512 };
+
+inline SimdLevel simd_level() {
+#ifdef POW_MOD_X86
+    static const SimdLevel level = __builtin_cpu_supports("avx512f") ? SimdLevel::AVX512
+        : __builtin_cpu_supports("avx2") ? SimdLevel::AVX2 : SimdLevel::SCALAR;
+    return level;
+#else
+    return SimdLevel::SCALAR;
+#endif
+}
+
+#ifdef POW_MOD_X86
+// GCC 12 flags the undefined-vector placeholders inside its own AVX-512 intrinsics when they are inlined here
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+namespace simd {
+
+__attribute__((target("avx2")))
+inline __m256i mont_mul8(__m256i a, __m256i b, __m256i p, __m256i inv) {
+    // even lanes in place, odd lanes shifted down, each as a 64-bit product
+    __m256i te = _mm256_mul_epu32(a, b);
+    __m256i to = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), _mm256_srli_epi64(b, 32));
+    __m256i de = _mm256_sub_epi64(te, _mm256_mul_epu32(_mm256_mul_epu32(te, inv), p));
+    __m256i d_o = _mm256_sub_epi64(to, _mm256_mul_epu32(_mm256_mul_epu32(to, inv), p));
+    __m256i d = _mm256_blend_epi32(_mm256_srli_epi64(de, 32), d_o, 0xAA);
+    return _mm256_min_epu32(d, _mm256_add_epi32(d, p));
+}
+
+__attribute__((target("avx512f")))
+inline __m512i mont_mul16(__m512i a, __m512i b, __m512i p, __m512i inv) {
+    __m512i te = _mm512_mul_epu32(a, b);
+    __m512i to = _mm512_mul_epu32(_mm512_srli_epi64(a, 32), _mm512_srli_epi64(b, 32));
+    __m512i de = _mm512_sub_epi64(te, _mm512_mul_epu32(_mm512_mul_epu32(te, inv), p));
+    __m512i d_o = _mm512_sub_epi64(to, _mm512_mul_epu32(_mm512_mul_epu32(to, inv), p));
+    __m512i d = _mm512_mask_blend_epi32(0xAAAA, _mm512_srli_epi64(de, 32), d_o);
+    return _mm512_min_epu32(d, _mm512_add_epi32(d, p));
+}
+
+// returns how many leading elements were done, a multiple of 8
+__attribute__((target("avx2")))
+inline size_t pow_mod_avx2(const uint32_t *bases, const uint32_t *exps, uint32_t *out, size_t n, const Montgomery<uint32_t> &mod) {
+    const __m256i p = _mm256_set1_epi32(mod.modulus()), inv = _mm256_set1_epi32(mod.inverse());
+    const __m256i r1 = _mm256_set1_epi32(mod.one()), r2 = _mm256_set1_epi32(mod.r_squared()), one = _mm256_set1_epi32(1);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        // base * 2^64 / 2^32 is the Montgomery form, and base < 2^32 keeps the product in range
+        __m256i cur = mont_mul8(_mm256_loadu_si256((const __m256i*)(bases + i)), r2, p, inv);
+        __m256i e = _mm256_loadu_si256((const __m256i*)(exps + i));
+        __m256i ans = r1;
+        while (!_mm256_testz_si256(e, e)) {
+            __m256i bit = _mm256_cmpeq_epi32(_mm256_and_si256(e, one), one);
+            ans = _mm256_blendv_epi8(ans, mont_mul8(ans, cur, p, inv), bit);
+            cur = mont_mul8(cur, cur, p, inv);
+            e = _mm256_srli_epi32(e, 1);
+        }
+        _mm256_storeu_si256((__m256i*)(out + i), mont_mul8(ans, one, p, inv));
+    }
+    return i;
+}
+
+__attribute__((target("avx512f")))
+inline size_t pow_mod_avx512(const uint32_t *bases, const uint32_t *exps, uint32_t *out, size_t n, const Montgomery<uint32_t> &mod) {
+    const __m512i p = _mm512_set1_epi32(mod.modulus()), inv = _mm512_set1_epi32(mod.inverse());
+    const __m512i r1 = _mm512_set1_epi32(mod.one()), r2 = _mm512_set1_epi32(mod.r_squared()), one = _mm512_set1_epi32(1);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i cur = mont_mul16(_mm512_loadu_si512(bases + i), r2, p, inv);
+        __m512i e = _mm512_loadu_si512(exps + i);
+        __m512i ans = r1;
+        while (_mm512_test_epi32_mask(e, e) != 0) {
+            ans = _mm512_mask_blend_epi32(_mm512_test_epi32_mask(e, one), ans, mont_mul16(ans, cur, p, inv));
+            cur = mont_mul16(cur, cur, p, inv);
+            e = _mm512_srli_epi32(e, 1);
+        }
+        _mm512_storeu_si512(out + i, mont_mul16(ans, one, p, inv));
+    }
+    return i;
+}
+
+// one table lookup and multiplication per window of every exponent, the lookups as gathers
+__attribute__((target("avx2")))
+inline size_t fixed_pow_avx2(const uint32_t *table, int w, int windows, const uint32_t *exps, uint32_t *out, size_t n, const Montgomery<uint32_t> &mod) {
+    const __m256i p = _mm256_set1_epi32(mod.modulus()), inv = _mm256_set1_epi32(mod.inverse()), one = _mm256_set1_epi32(1);
+    const __m256i mask = _mm256_set1_epi32((1 << w) - 1);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i e = _mm256_loadu_si256((const __m256i*)(exps + i));
+        __m256i ans = _mm256_i32gather_epi32((const int*)table, _mm256_and_si256(e, mask), 4);
+        for (int k = 1; k < windows; ++k) {
+            e = _mm256_srli_epi32(e, w);
+            __m256i idx = _mm256_add_epi32(_mm256_and_si256(e, mask), _mm256_set1_epi32(k << w));
+            ans = mont_mul8(ans, _mm256_i32gather_epi32((const int*)table, idx, 4), p, inv);
+        }
+        _mm256_storeu_si256((__m256i*)(out + i), mont_mul8(ans, one, p, inv));
+    }
+    return i;
+}
+
+__attribute__((target("avx512f")))
+inline size_t fixed_pow_avx512(const uint32_t *table, int w, int windows, const uint32_t *exps, uint32_t *out, size_t n, const Montgomery<uint32_t> &mod) {
+    const __m512i p = _mm512_set1_epi32(mod.modulus()), inv = _mm512_set1_epi32(mod.inverse()), one = _mm512_set1_epi32(1);
+    const __m512i mask = _mm512_set1_epi32((1 << w) - 1);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i e = _mm512_loadu_si512(exps + i);
+        __m512i ans = _mm512_i32gather_epi32(_mm512_and_si512(e, mask), table, 4);
+        for (int k = 1; k < windows; ++k) {
+            e = _mm512_srli_epi32(e, w);
+            __m512i idx = _mm512_add_epi32(_mm512_and_si512(e, mask), _mm512_set1_epi32(k << w));
+            ans = mont_mul16(ans, _mm512_i32gather_epi32(idx, table, 4), p, inv);
+        }
+        _mm512_storeu_si512(out + i, mont_mul16(ans, one, p, inv));
+    }
+    return i;
+}
+
+}  // namespace simd
+#pragma GCC diagnostic pop
+#endif
+
+// out[i] = bases[i]^exps[i] mod p for i < n, vectorized up to level where the modulus allows it
+template <typename Mod>
+void pow_mod_batch(const typename Mod::value_type *bases, const typename Mod::value_type *exps, typename Mod::value_type *out,
+                   size_t n, const Mod &mod, SimdLevel level = simd_level()) {
+    size_t done = 0;
+#ifdef POW_MOD_X86
+    if constexpr (is_same_v<Mod, Montgomery<uint32_t>>) {
+        level = min(level, simd_level());
+        if (mod.modulus() < (1u << 31)) {
+            if (level == SimdLevel::AVX512) done = simd::pow_mod_avx512(bases, exps, out, n, mod);
+            else if (level == SimdLevel::AVX2) done = simd::pow_mod_avx2(bases, exps, out, n, mod);
+        }
+    }
+#endif
+    for (size_t i = done; i < n; ++i) out[i] = pow_mod(bases[i], exps[i], mod);
+}
+
+/*
+    g^e mod p for one fixed g and many e: table[k][d] = g^(d * 2^(k * w)), so g^e is the product of one
+    entry per w-bit digit of e, bits / w multiplications and no squaring. The table holds
+    (bits / w) * 2^w values, 1024 for 32-bit exponents and the default w = 8.
+*/
+template <typename Mod>
+class FixedBasePow {
+public:
+    using T = typename Mod::value_type;
+    static constexpr int BITS = numeric_limits<T>::digits;
+
+    FixedBasePow(T g, const Mod &mod, int w = 8): mod(mod), w(w), windows((BITS + w - 1) / w), table(size_t(windows) << w) {
+        assert(1 <= w && w <= 16);
+        T base = mod.to(g);
+        for (int k = 0; k < windows; ++k) {
+            T *row = &table[size_t(k) << w];
+            row[0] = mod.one();
+            for (int d = 1; d < (1 << w); ++d) row[d] = mod.mul(row[d - 1], base);
+            base = mod.mul(row[(1 << w) - 1], base);
+        }
+    }
+
+    T operator() (T e) const {
+        T ans = table[e & ((T(1) << w) - 1)];
+        for (int k = 1; k < windows; ++k) {
+            e >>= w;
+            ans = mod.mul(ans, table[(size_t(k) << w) + (e & ((T(1) << w) - 1))]);
+        }
+        return mod.from(ans);
+    }
+
+    void batch(const T *exps, T *out, size_t n, SimdLevel level = simd_level()) const {
+        size_t done = 0;
+#ifdef POW_MOD_X86
+        if constexpr (is_same_v<Mod, Montgomery<uint32_t>>) {
+            level = min(level, simd_level());
+            if (mod.modulus() < (1u << 31)) {
+                if (level == SimdLevel::AVX512) done = simd::fixed_pow_avx512(table.data(), w, windows, exps, out, n, mod);
+                else if (level == SimdLevel::AVX2) done = simd::fixed_pow_avx2(table.data(), w, windows, exps, out, n, mod);
+            }
+        }
+#endif
+        for (size_t i = done; i < n; ++i) out[i] = (*this)(exps[i]);
+    }
+
+private:
+    Mod mod;
+    int w, windows;
+    vector<T> table;
+};
+
+/*
+    Primality and factorization of 64-bit integers, all products through Montgomery so nothing overflows.
+    is_prime: trial division by the primes below 64, then Miller-Rabin with bases that are proven
+    deterministic: {2, 7, 61} below 2^32 and the seven bases of Jim Sinclair above.
+*/
+const uint32_t SMALL_PRIMES[] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53, 59, 61};
+
+// n - 1 = d * 2^s, one Miller-Rabin round in the Montgomery domain of n
+template <typename T>
+inline bool miller_rabin(T n, T d, int s, T a, const Montgomery<T> &mont) {
+    a %= n;
+    if (a == 0) return true;
+    T x = mont.to(pow_mod(a, d, mont)), one = mont.one(), minus_one = mont.to(n - 1);
+    if (x == one || x == minus_one) return true;
+    for (int i = 1; i < s; ++i) {
+        x = mont.mul(x, x);
+        if (x == minus_one) return true;
+    }
+    return false;
+}
+
+inline bool is_prime(uint64_t n) {
+    if (n < 2) return false;
+    for (uint32_t p: SMALL_PRIMES) {
+        if (n % p == 0) return n == p;
+    }
+    if (n < 67 * 67) return true;
+
+    int s = __builtin_ctzll(n - 1);
+    if (n >> 32 == 0) {
+        uint32_t m = uint32_t(n), d = (m - 1) >> s;
+        Montgomery<uint32_t> mont(m);
+        for (uint32_t a: {2u, 7u, 61u}) {
+            if (!miller_rabin(m, d, s, a, mont)) return false;
+        }
+        return true;
+    }
+    uint64_t d = (n - 1) >> s;
+    Montgomery<uint64_t> mont(n);
+    for (uint64_t a: {2ull, 325ull, 9375ull, 28178ull, 450775ull, 9780504ull, 1795265022ull}) {
+        if (!miller_rabin(n, d, s, a, mont)) return false;
+    }
+    return true;
+}
+
+/*
+    A non-trivial factor of an odd composite n, by Pollard's rho with Brent's cycle detection:
+    x walks x^2 + c in the Montgomery domain of n (a difference there is (x - y) * R, and R is coprime to n),
+    the differences of a block of up to 128 steps are multiplied together and only then gcd'ed with n.
+    If a block overshoots to gcd n it is replayed one step at a time, and a walk that only finds n itself
+    is restarted with the next c.
+*/
+inline uint64_t pollard_brent(uint64_t n) {
+    Montgomery<uint64_t> mont(n);
+    const int BLOCK = 128;
+    for (uint64_t c = 1; ; ++c) {
+        uint64_t cm = mont.to(c), y = mont.to(2), x = y, saved = y, q = mont.one(), g = 1;
+        // v^2 + c mod n without forming the sum, which wraps for n > 2^63
+        auto f = [&](uint64_t v) {
+            v = mont.mul(v, v);
+            return v >= n - cm ? v - (n - cm) : v + cm;
+        };
+        for (uint64_t r = 1; g == 1; r <<= 1) {
+            x = y;
+            for (uint64_t i = 0; i < r; ++i) y = f(y);
+            for (uint64_t k = 0; k < r && g == 1; k += BLOCK) {
+                saved = y;
+                for (uint64_t i = 0; i < min<uint64_t>(BLOCK, r - k); ++i) {
+                    y = f(y);
+                    q = mont.mul(q, x > y ? x - y : y - x);
+                }
+                g = gcd(q, n);
+            }
+        }
+        if (g == n) {
+            do {
+                saved = f(saved);
+                g = gcd(x > saved ? x - saved : saved - x, n);
+            } while (g == 1);
+        }
+        if (g != n) return g;
+    }
+}
+
+// prime factors of n in ascending order, with multiplicity; empty for 0 and 1
+inline vector<uint64_t> factorize(uint64_t n) {
+    vector<uint64_t> factors;
+    if (n == 0) return factors;
+    for (uint32_t p: SMALL_PRIMES) {
+        while (n % p == 0) {
+            factors.push_back(p);
+            n /= p;
+        }
+    }
+    vector<uint64_t> pending;
+    if (n > 1) pending.push_back(n);
+    while (!pending.empty()) {
+        uint64_t m = pending.back();
+        pending.pop_back();
+        if (is_prime(m)) {
+            factors.push_back(m);
+            continue;
+        }
+        uint64_t d = pollard_brent(m);
+        pending.push_back(d);
+        pending.push_back(m / d);
+    }
+    sort(factors.begin(), factors.end());
+    return factors;
+}
+
+inline vector<uint32_t> odd_primes_upto(uint64_t n);
+
+/*
+    fn(p) for every prime lo <= p < hi, in ascending order. The odd numbers of the range are crossed out
+    in segments of SEGMENT bytes, one byte per odd number, small enough to stay in L1 while every base
+    prime up to sqrt(hi) strikes through it; each base prime keeps the offset of its next multiple
+    relative to the next segment. Positions are counted from lo and never formed past hi, so ranges
+    ending at 2^64 - 1 do not wrap.
+*/
+template <typename Fn>
+void segmented_sieve(uint64_t lo, uint64_t hi, Fn fn) {
+    const uint64_t SEGMENT = 32 * 1024;
+    if (hi <= lo) return;
+    if (lo <= 2 && 2 < hi) fn(uint64_t(2));
+    lo = max<uint64_t>(lo, 3) | 1;
+    if (hi <= lo) return;
+
+    // odd base primes up to sqrt(hi - 1) < 2^32
+    uint64_t root = min<uint64_t>(uint64_t(sqrtl(hi - 1)), UINT32_MAX);
+    while (root * root > hi - 1) --root;
+    while (root < UINT32_MAX && (root + 1) * (root + 1) <= hi - 1) ++root;
+    vector<uint32_t> primes = odd_primes_upto(root);
+    // next[i]: index of the first odd multiple >= max(p^2, lo), segment[k] standing for lo + 2k
+    vector<uint64_t> next(primes.size());
+    for (size_t i = 0; i < primes.size(); ++i) {
+        uint64_t p = primes[i], square = p * p;
+        if (square >= lo) {
+            next[i] = (square - lo) / 2;
+        } else {
+            // lo + d is the first multiple of p, and an odd one when d is even
+            uint64_t d = (p - lo % p) % p;
+            next[i] = (d & 1 ? d + p : d) / 2;
+        }
+    }
+
+    vector<char> segment(SEGMENT);
+    uint64_t odds = (hi - lo + 1) / 2;
+    for (uint64_t start = 0; start < odds; start += SEGMENT) {
+        // segment[k] stands for base + 2k
+        uint64_t base = lo + 2 * start, len = min(SEGMENT, odds - start);
+        fill(segment.begin(), segment.begin() + len, 0);
+        for (size_t i = 0; i < primes.size(); ++i) {
+            uint64_t k = next[i], step = primes[i];
+            for (; k < len; k += step) segment[k] = 1;
+            next[i] = k - len;
+        }
+        for (uint64_t k = 0; k < len; ++k) {
+            if (!segment[k]) fn(base + 2 * k);
+        }
+    }
+}
+
+/*
+    Odd primes up to n <= 2^32 - 1. Small n gets a plain odd-only sieve; larger n goes through
+    segmented_sieve(), whose own base primes stop at 2^16, so memory stays at the primes themselves.
+*/
+inline vector<uint32_t> odd_primes_upto(uint64_t n) {
+    vector<uint32_t> primes;
+    if (n < (1u << 20)) {
+        // composite[i] stands for 2i + 1
+        vector<char> composite(n / 2 + 1, 0);
+        for (uint64_t i = 3; i <= n; i += 2) {
+            if (composite[i / 2]) continue;
+            primes.push_back(uint32_t(i));
+            for (uint64_t j = i * i; j <= n; j += 2 * i) composite[j / 2] = 1;
+        }
+        return primes;
+    }
+    segmented_sieve(3, n + 1, [&](uint64_t p) { primes.push_back(uint32_t(p)); });
+    return primes;
+}
+
+inline vector<uint64_t> primes_between(uint64_t lo, uint64_t hi) {
+    vector<uint64_t> primes;
+    segmented_sieve(lo, hi, [&](uint64_t p) { primes.push_back(p); });
+    return primes;
+}
+
+/*
+    Number-theoretic transform modulo a prime p < 2^31 with 2^k | p - 1 and primitive root g, for
+    convolutions of up to 2^k coefficients.
+    The forward pass is decimation in frequency: natural order in, bit-reversed order out. The inverse is
+    decimation in time: bit-reversed in, natural out. A convolution never reorders anything in between,
+    so there is no bit-reversal pass. A stage of half-length h walks its twiddles w^0 .. w^(h-1)
+    front to back, and the table keeps them next to each other, at [h, 2h).
+    Twiddles are stored in Montgomery form and the data is not: mont.mul(x, w) of a plain x and a
+    Montgomery w is the plain x * w, so a transform needs no conversion. The pointwise product of two
+    plain values picks up one factor of R^-1, which the final 1 / n scaling takes back.
+    Tables are built once per (p, size) and shared by every NTT object through a cache.
+*/
+class NTT {
+public:
+    NTT(uint32_t p, uint32_t g): p(p), g(g), mont(p) {
+        assert(p < (1u << 31) && (p & 1));
+    }
+
+    uint32_t modulus() const { return p; }
+
+    // largest transform p supports
+    size_t max_size() const { return size_t(1) << __builtin_ctz(p - 1); }
+
+    // in place, a.size() a power of two up to max_size(), values below p
+    void forward(vector<uint32_t> &a, int threads = 1) const {
+        size_t n = a.size();
+        auto tw = twiddles(n);
+        uint32_t *x = a.data();
+        const uint32_t p = this->p, inv = mont.inverse();
+        for (size_t h = n >> 1; h >= 1; h >>= 1) {
+            const uint32_t *w = tw->roots.data() + h;
+            stage(n, h, threads, [=](size_t i, size_t lo, size_t hi) {
+                uint32_t *l = x + i, *r = x + i + h;
+                for (size_t j = lo; j < hi; ++j) {
+                    uint32_t u = l[j], v = r[j];
+                    l[j] = add(u, v, p);
+                    r[j] = mul(sub(u, v, p), w[j], p, inv);
+                }
+            });
+        }
+    }
+
+    // the inverse of forward() up to the factor n, which the caller folds into its last multiplication
+    void inverse_unscaled(vector<uint32_t> &a, int threads = 1) const {
+        size_t n = a.size();
+        auto tw = twiddles(n);
+        uint32_t *x = a.data();
+        const uint32_t p = this->p, inv = mont.inverse();
+        for (size_t h = 1; h < n; h <<= 1) {
+            const uint32_t *w = tw->inverse_roots.data() + h;
+            stage(n, h, threads, [=](size_t i, size_t lo, size_t hi) {
+                uint32_t *l = x + i, *r = x + i + h;
+                for (size_t j = lo; j < hi; ++j) {
+                    uint32_t u = l[j], v = mul(r[j], w[j], p, inv);
+                    l[j] = add(u, v, p);
+                    r[j] = sub(u, v, p);
+                }
+            });
+        }
+    }
+
+    // a * b mod p, a.size() + b.size() - 1 coefficients, inputs below p
+    vector<uint32_t> convolve(vector<uint32_t> a, vector<uint32_t> b, int threads = 1) const {
+        if (a.empty() || b.empty()) return {};
+        size_t m = a.size() + b.size() - 1, n = 1;
+        while (n < m) n <<= 1;
+        assert(n <= max_size());
+        a.resize(n);
+        b.resize(n);
+        forward(a, threads);
+        forward(b, threads);
+        for (size_t i = 0; i < n; ++i) a[i] = mont.mul(a[i], b[i]);
+        inverse_unscaled(a, threads);
+        // a[i] * R^-1 * n so far: n^-1 * R^2 turns it into the plain coefficient
+        uint32_t scale = mont.to(mont.to(pow_mod<uint64_t>(n, p - 2, p)));
+        for (size_t i = 0; i < m; ++i) a[i] = mont.mul(a[i], scale);
+        a.resize(m);
+        return a;
+    }
+
+private:
+    struct Twiddles {
+        vector<uint32_t> roots, inverse_roots;
+    };
+
+    // roots[h + j] = w^j for w a primitive 2h-th root of unity, in Montgomery form
+    shared_ptr<const Twiddles> twiddles(size_t n) const {
+        assert((n & (n - 1)) == 0 && n <= max_size());
+        static mutex lock;
+        static map<pair<uint32_t, size_t>, shared_ptr<const Twiddles>> cache;
+        lock_guard<mutex> guard(lock);
+        auto &entry = cache[{p, n}];
+        if (entry == nullptr) {
+            auto tw = make_shared<Twiddles>();
+            tw->roots.resize(max<size_t>(n, 2));
+            tw->inverse_roots.resize(max<size_t>(n, 2));
+            for (size_t h = 1; h < n; h <<= 1) {
+                uint32_t w = pow_mod<uint64_t>(g, (p - 1) / (2 * h), p);
+                uint32_t wm = mont.to(w), iwm = mont.to(pow_mod<uint64_t>(w, p - 2, p));
+                uint32_t cur = mont.one(), icur = mont.one();
+                for (size_t j = 0; j < h; ++j) {
+                    tw->roots[h + j] = cur;
+                    tw->inverse_roots[h + j] = icur;
+                    cur = mont.mul(cur, wm);
+                    icur = mont.mul(icur, iwm);
+                }
+            }
+            entry = tw;
+        }
+        return entry;
+    }
+
+    /*
+        The n / 2 butterflies of one stage, k -> (block start i, offset j), handed out as runs
+        butterfly(i, lo, hi) over offsets [lo, hi) of one block. Large transforms cut them into contiguous
+        slices, one per thread.
+    */
+    template <typename Butterfly>
+    static void stage(size_t n, size_t h, int threads, Butterfly butterfly) {
+        auto slice = [&](size_t lo, size_t hi) {
+            while (lo < hi) {
+                size_t i = (lo / h) * 2 * h, j = lo % h;
+                size_t stop = min(h, j + (hi - lo));
+                butterfly(i, j, stop);
+                lo += stop - j;
+            }
+        };
+        size_t half = n / 2;
+        if (threads <= 1 || n < PARALLEL_SIZE) {
+            slice(0, half);
+            return;
+        }
+        vector<thread> workers;
+        for (int t = 1; t < threads; ++t) workers.emplace_back(slice, half * t / threads, half * (t + 1) / threads);
+        slice(0, half / threads);
+        for (thread &w: workers) w.join();
+    }
+
+    /*
+        Branch-free arithmetic for the butterflies. With p < 2^31 a wrapped difference is above every
+        in-range value, so min() of the two candidates picks the reduced one.
+    */
+    static uint32_t add(uint32_t a, uint32_t b, uint32_t p) {
+        return min(a + b, a + b - p);
+    }
+
+    static uint32_t sub(uint32_t a, uint32_t b, uint32_t p) {
+        return min(a - b, a - b + p);
+    }
+
+    // a * b * R^-1 mod p, inv = p^-1 mod 2^32 as in Montgomery::reduce
+    static uint32_t mul(uint32_t a, uint32_t b, uint32_t p, uint32_t inv) {
+        uint64_t t = uint64_t(a) * b;
+        uint32_t q = uint32_t(t) * inv;
+        uint32_t d = uint32_t(t >> 32) - uint32_t((uint64_t(q) * p) >> 32);
+        return min(d, d + p);
+    }
+
+    static const size_t PARALLEL_SIZE = 1 << 16;
+
+    uint32_t p, g;
+    Montgomery<uint32_t> mont;
+};
+
+/*
+    Exact convolution of non-negative inputs below 2^30 with up to 2^23 result coefficients: three NTT
+    primes, then Garner's CRT. Coefficients reach 2^23 * 2^60 = 2^83, below the product of the primes (> 2^86).
+*/
+inline vector<unsigned __int128> convolve_exact(const vector<uint32_t> &a, const vector<uint32_t> &b, int threads = 1) {
+    const uint32_t P1 = 998244353, P2 = 167772161, P3 = 469762049;
+    auto reduce = [](const vector<uint32_t> &v, uint32_t p) {
+        vector<uint32_t> r(v.size());
+        for (size_t i = 0; i < v.size(); ++i) r[i] = v[i] % p;
+        return r;
+    };
+    vector<uint32_t> r1 = NTT(P1, 3).convolve(reduce(a, P1), reduce(b, P1), threads);
+    vector<uint32_t> r2 = NTT(P2, 3).convolve(reduce(a, P2), reduce(b, P2), threads);
+    vector<uint32_t> r3 = NTT(P3, 3).convolve(reduce(a, P3), reduce(b, P3), threads);
+
+    const uint64_t q1 = P1, q2 = P2, q3 = P3;
+    const uint64_t inv1 = pow_mod<uint64_t>(q1 % q2, q2 - 2, q2);
+    const uint64_t inv12 = pow_mod<uint64_t>(q1 * q2 % q3, q3 - 2, q3);
+    vector<unsigned __int128> result(r1.size());
+    for (size_t i = 0; i < r1.size(); ++i) {
+        // x = t1 + q1 * t2 + q1 * q2 * t3, each t chosen so that x matches one more residue
+        uint64_t t1 = r1[i];
+        uint64_t t2 = (r2[i] + q2 - t1 % q2) % q2 * inv1 % q2;
+        uint64_t low = (t1 + q1 * t2) % q3;
+        uint64_t t3 = (r3[i] + q3 - low) % q3 * inv12 % q3;
+        result[i] = t1 + (unsigned __int128)q1 * t2 + (unsigned __int128)(q1 * q2) * t3;
+    }
+    return result;
+}
+
+// a * b mod any m < 2^30
+inline vector<uint32_t> convolve_mod(const vector<uint32_t> &a, const vector<uint32_t> &b, uint32_t m, int threads = 1) {
+    vector<uint32_t> ra(a.size()), rb(b.size());
+    for (size_t i = 0; i < a.size(); ++i) ra[i] = a[i] % m;
+    for (size_t i = 0; i < b.size(); ++i) rb[i] = b[i] % m;
+    vector<unsigned __int128> exact = convolve_exact(ra, rb, threads);
+    vector<uint32_t> r(exact.size());
+    for (size_t i = 0; i < exact.size(); ++i) r[i] = uint32_t(exact[i] % m);
+    return r;
+}
+
+// product of two non-negative decimal numbers, four digits per coefficient
+inline string multiply_decimal(const string &x, const string &y, int threads = 1) {
+    const uint32_t BASE = 10000;
+    auto limbs = [](const string &s) {
+        vector<uint32_t> v;
+        for (int end = int(s.size()); end > 0; end -= 4) {
+            int begin = max(0, end - 4);
+            v.push_back(stoi(s.substr(begin, end - begin)));
+        }
+        return v;
+    };
+    vector<unsigned __int128> c = convolve_exact(limbs(x), limbs(y), threads);
+    string digits;
+    unsigned __int128 carry = 0;
+    for (size_t i = 0; i < c.size() || carry > 0; ++i) {
+        if (i < c.size()) carry += c[i];
+        uint32_t limb = uint32_t(carry % BASE);
+        carry /= BASE;
+        for (int k = 0; k < 4; ++k, limb /= 10) digits.push_back(char('0' + limb % 10));
+    }
+    while (digits.size() > 1 && digits.back() == '0') digits.pop_back();
+    reverse(digits.begin(), digits.end());
+    return digits;
+}
+
+namespace bench {
+
+using Clock = chrono::steady_clock;
+
+inline double elapsed_ms(Clock::time_point from) {
+    return chrono::duration<double, milli>(Clock::now() - from).count();
+}
+
+// ns per exponentiation with full-width exponents, generic pow_mod against the reduction engines
+template <typename T>
+void run_modulus(T p, int n) {
+    mt19937_64 rng(20240601);
+    vector<T> bases(n), exps(n);
+    for (int i = 0; i < n; ++i) {
+        bases[i] = T(rng());
+        exps[i] = T(rng());
+    }
+    Montgomery<T> mont(p);
+    Barrett<T> barrett(p);
+    vector<T> expected(n);
+
+    auto t0 = Clock::now();
+    for (int i = 0; i < n; ++i) expected[i] = pow_mod(bases[i], exps[i], p);
+    double plain = elapsed_ms(t0);
+
+    bool same = true;
+    auto measure = [&](auto &&f) {
+        auto t0 = Clock::now();
+        for (int i = 0; i < n; ++i) same = f(bases[i], exps[i]) == expected[i] && same;
+        return elapsed_ms(t0);
+    };
+    double b = measure([&](T m, T e) { return pow_mod(m, e, barrett); });
+    double mg = measure([&](T m, T e) { return pow_mod(m, e, mont); });
+    double mw = measure([&](T m, T e) { return pow_mod_window(m, e, mont); });
+
+    auto ns = [n](double ms) { return ms * 1e6 / n; };
+    cout <<numeric_limits<T>::digits <<"-bit p=" <<p <<" (ns/pow)" <<(same ? "" : " MISMATCH") <<endl
+         <<"  pow_mod      " <<ns(plain) <<endl
+         <<"  barrett      " <<ns(b) <<endl
+         <<"  montgomery   " <<ns(mg) <<endl
+         <<"  mont+window  " <<ns(mw) <<endl;
+}
+
+inline void run(int n) {
+    run_modulus<uint32_t>(998244353u, n);
+    run_modulus<uint32_t>(4294967291u, n);
+    run_modulus<uint64_t>((1ull << 61) - 1, n);
+    run_modulus<uint64_t>(18446744073709551557ull, n);
+}
+
+// exponentiations per second over a shared modulus: scalar / AVX2 / AVX-512 batches and the fixed-base table
+inline void run_batch(int n) {
+    const uint32_t p = 998244353u, g = 3;
+    Montgomery<uint32_t> mont(p);
+    mt19937 rng(20240601);
+    vector<uint32_t> bases(n), exps(n), expected(n), out(n), generator(n, g);
+    for (int i = 0; i < n; ++i) {
+        bases[i] = rng();
+        exps[i] = rng();
+    }
+    for (int i = 0; i < n; ++i) expected[i] = pow_mod(bases[i], exps[i], p);
+
+    auto mps = [n](double ms) { return n / ms / 1000; };
+    cout <<"n=" <<n <<" p=" <<p <<" (Mpow/s)" <<endl;
+    const pair<SimdLevel, string> levels[] = {{SimdLevel::SCALAR, "scalar"}, {SimdLevel::AVX2, "avx2"}, {SimdLevel::AVX512, "avx512"}};
+    for (auto &[level, name]: levels) {
+        if (level > simd_level()) continue;
+        auto t0 = Clock::now();
+        pow_mod_batch(bases.data(), exps.data(), out.data(), n, mont, level);
+        double ms = elapsed_ms(t0);
+        cout <<"  batch " <<name <<" " <<mps(ms) <<(out == expected ? "" : " MISMATCH") <<endl;
+    }
+
+    for (int i = 0; i < n; ++i) expected[i] = pow_mod(g, exps[i], p);
+    auto t0 = Clock::now();
+    FixedBasePow<Montgomery<uint32_t>> fixed(g, mont);
+    cout <<"  fixed-base table built in " <<elapsed_ms(t0) <<"ms" <<endl;
+    t0 = Clock::now();
+    pow_mod_batch(generator.data(), exps.data(), out.data(), n, mont);
+    double ms = elapsed_ms(t0);
+    cout <<"  g^e batch " <<mps(ms) <<(out == expected ? "" : " MISMATCH") <<endl;
+    for (auto &[level, name]: levels) {
+        if (level > simd_level()) continue;
+        auto t0 = Clock::now();
+        fixed.batch(exps.data(), out.data(), n, level);
+        double ms = elapsed_ms(t0);
+        cout <<"  g^e fixed " <<name <<" " <<mps(ms) <<(out == expected ? "" : " MISMATCH") <<endl;
+    }
+}
+
+// numbers/sec of is_prime, factorize and the sieve, each checked against another method
+inline void run_number_theory(int n, uint64_t range) {
+    mt19937_64 rng(20240601);
+    auto per_sec = [](uint64_t count, double ms) { return count / ms * 1000; };
+
+    // the sieve and is_prime have to agree on a window far above 2^32
+    const uint64_t lo = 1000000000000ull;
+    auto t0 = Clock::now();
+    uint64_t sieved = 0, checked = 0;
+    segmented_sieve(lo, lo + range, [&](uint64_t) { ++sieved; });
+    double sieve_ms = elapsed_ms(t0);
+    for (uint64_t x = lo; x < lo + 1000000; ++x) checked += is_prime(x);
+    vector<uint64_t> window = primes_between(lo, lo + 1000000);
+    cout <<"sieve [1e12, 1e12 + " <<range <<"): " <<sieved <<" primes, " <<per_sec(range, sieve_ms) / 1e6 <<"M numbers/s"
+         <<(window.size() == checked ? "" : " MISMATCH") <<endl;
+
+    for (int bits: {32, 64}) {
+        vector<uint64_t> xs(n);
+        for (uint64_t &x: xs) x = (bits == 64 ? rng() : rng() >> 32) | 1;
+        t0 = Clock::now();
+        uint64_t primes = 0;
+        for (uint64_t x: xs) primes += is_prime(x);
+        cout <<"is_prime " <<bits <<"-bit odd: " <<per_sec(n, elapsed_ms(t0)) / 1e6 <<"M numbers/s (" <<primes <<" primes)" <<endl;
+    }
+
+    // products of two random 32-bit primes are the hard case for rho
+    vector<uint64_t> semiprimes(n / 10);
+    for (uint64_t &x: semiprimes) {
+        uint64_t p, q;
+        do p = rng() >> 32; while (!is_prime(p));
+        do q = rng() >> 32; while (!is_prime(q));
+        x = p * q;
+    }
+    vector<uint64_t> random(n / 10);
+    for (uint64_t &x: random) x = rng();
+    for (auto &[name, xs]: vector<pair<string, vector<uint64_t>*>>{{"semiprime", &semiprimes}, {"random 64-bit", &random}}) {
+        bool same = true;
+        t0 = Clock::now();
+        for (uint64_t x: *xs) {
+            vector<uint64_t> f = factorize(x);
+            uint64_t product = 1;
+            for (uint64_t p: f) product *= p;
+            same = same && product == x && all_of(f.begin(), f.end(), is_prime);
+        }
+        cout <<"factorize " <<name <<": " <<per_sec(xs->size(), elapsed_ms(t0)) <<" numbers/s" <<(same ? "" : " MISMATCH") <<endl;
+    }
+}
+
+// schoolbook a * b mod p, the O(n^2) loop the NTT replaces
+inline vector<uint32_t> schoolbook(const vector<uint32_t> &a, const vector<uint32_t> &b, uint32_t p) {
+    vector<uint64_t> acc(a.size() + b.size() - 1);
+    vector<uint32_t> r(acc.size());
+    for (size_t i = 0; i < a.size(); ++i) {
+        for (size_t j = 0; j < b.size(); ++j) {
+            // products stay below 2^60, reduce before sixteen of them could overflow
+            acc[i + j] += uint64_t(a[i]) * b[j];
+            if ((j & 15) == 15) acc[i + j] %= p;
+        }
+        for (size_t j = max<size_t>(b.size(), 16) - 16; j < b.size(); ++j) acc[i + j] %= p;
+    }
+    for (size_t i = 0; i < acc.size(); ++i) r[i] = uint32_t(acc[i] % p);
+    return r;
+}
+
+// ms per product of two polynomials with n / 2 coefficients each (n result coefficients), NTT against schoolbook
+inline void run_ntt(int max_log, int schoolbook_log, int threads) {
+    const uint32_t p = 998244353;
+    NTT ntt(p, 3);
+    mt19937 rng(20240601);
+    for (int lg = 10; lg <= max_log; ++lg) {
+        size_t n = size_t(1) << lg;
+        vector<uint32_t> a(n / 2), b(n / 2);
+        for (uint32_t &x: a) x = rng() % p;
+        for (uint32_t &x: b) x = rng() % p;
+        ntt.convolve({1}, {1});
+
+        auto t0 = Clock::now();
+        vector<uint32_t> c = ntt.convolve(a, b);
+        double one = elapsed_ms(t0);
+        t0 = Clock::now();
+        vector<uint32_t> d = ntt.convolve(a, b, threads);
+        double many = elapsed_ms(t0);
+        t0 = Clock::now();
+        vector<uint32_t> e = convolve_mod(a, b, 1000000007);
+        double crt = elapsed_ms(t0);
+
+        bool same = c == d;
+        cout <<"n=2^" <<lg <<" ntt=" <<one <<"ms ntt x" <<threads <<"=" <<many <<"ms 3-prime mod 1e9+7=" <<crt <<"ms";
+        if (lg <= schoolbook_log) {
+            t0 = Clock::now();
+            vector<uint32_t> s = schoolbook(a, b, p);
+            double school = elapsed_ms(t0);
+            vector<uint32_t> ra(a), rb(b);
+            for (uint32_t &x: ra) x %= 1000000007;
+            for (uint32_t &x: rb) x %= 1000000007;
+            same = same && s == c && (lg > 14 || schoolbook(ra, rb, 1000000007) == e);
+            cout <<" schoolbook=" <<school <<"ms";
+        }
+        cout <<(same ? "" : " MISMATCH") <<endl;
+    }
+    cout <<multiply_decimal("123456789012345678901234567890", "987654321098765432109876543210") <<endl;
+}
+
+}  // namespace bench
+
+int main(int argc, char **argv) {
+    if (argc > 1 && string(argv[1]) == "bench") {
+        bench::run(argc > 2 ? atoi(argv[2]) : 1000000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "prime") {
+        bench::run_number_theory(argc > 2 ? atoi(argv[2]) : 1000000, argc > 3 ? atoll(argv[3]) : 100000000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "ntt") {
+        int threads = argc > 4 ? atoi(argv[4]) : max(1u, thread::hardware_concurrency());
+        bench::run_ntt(argc > 2 ? atoi(argv[2]) : 23, argc > 3 ? atoi(argv[3]) : 16, max(1, threads));
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "batch") {
+        bench::run_batch(argc > 2 ? atoi(argv[2]) : 1 << 22);
+        return 0;
+    }
+
     cout <<pow_mod(9, 0, 7) <<endl;
     cout <<pow_mod(9, 1, 7) <<endl;
     cout <<pow_mod(3, 2, 7) <<endl;
     cout <<pow_mod(2, 13, 11) <<endl;
+
+    // 2^64 - 59 is prime, so by Fermat 3^(p - 1) = 1
+    const uint64_t p = 18446744073709551557ull;
+    cout <<pow_mod<uint64_t>(3, p - 1, p) <<" " <<pow_mod(uint64_t(3), p - 1, Montgomery<uint64_t>(p))
+         <<" " <<pow_mod(uint64_t(3), p - 1, Barrett<uint64_t>(p)) <<endl;
     return 0;
-}
\ No newline at end of file
+}
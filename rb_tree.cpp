@@ -6,20 +6,738 @@
 #include <cstddef>
 #include <utility>
 #include <algorithm>
+#include <memory>
+#include <type_traits>
+#include <chrono>
+#include <random>
+#include <map>
+#include <limits>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <fstream>
+#include <stdexcept>
+#include <cstring>
+#include <cmath>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 using namespace std;
 
+/**
+ * Slab allocator for one object at a time, the default node allocator of RBTree.
+ * Slabs double from 64 up to 65536 slots, freed slots go to an intrusive free list,
+ * and release() returns every slab at once without touching the objects in them.
+ * Each rebound copy starts its own empty pool. Slabs are reference counted so that a container
+ * handing nodes to another one (RBTree::split / join) can adopt() or share() the slabs behind them.
+*/
+template <typename T>
+class NodePool {
+public:
+    using value_type = T;
+
+    NodePool() = default;
+    NodePool(const NodePool&) {}
+    template <typename U> NodePool(const NodePool<U>&) {}
+    NodePool& operator= (const NodePool&) = delete;
+
+    ~NodePool() {
+        release();
+    }
+
+    T* allocate(size_t n) {
+        assert(n == 1);
+        if (free_list != nullptr) {
+            Slot *slot = free_list;
+            free_list = slot->next;
+            return reinterpret_cast<T*>(slot);
+        }
+        if (used == capacity) grow();
+        return reinterpret_cast<T*>(&slabs.back().get()[used++]);
+    }
+
+    void deallocate(T *p, size_t) noexcept {
+        Slot *slot = reinterpret_cast<Slot*>(p);
+        slot->next = free_list;
+        free_list = slot;
+    }
+
+    // drop every slot in O(#slabs), objects still alive in them are not destroyed
+    void release() noexcept {
+        slabs.clear();
+        free_list = nullptr;
+        used = capacity = 0;
+    }
+
+    // take over the slabs and free slots of other, which ends up empty
+    void adopt(NodePool &other) {
+        if (other.free_list != nullptr) {
+            Slot *tail = other.free_list;
+            while (tail->next != nullptr) tail = tail->next;
+            tail->next = free_list;
+            free_list = other.free_list;
+        }
+        share(other);
+        other.release();
+    }
+
+    // keep the slabs of other alive for as long as this pool lives too
+    void share(const NodePool &other) {
+        // skip slabs held already, trees that split and join again would otherwise pile up references
+        vector<Slot*> held;
+        for (auto &slab: slabs) held.push_back(slab.get());
+        sort(held.begin(), held.end());
+        vector<shared_ptr<Slot>> added;
+        for (auto &slab: other.slabs) {
+            if (!binary_search(held.begin(), held.end(), slab.get())) added.push_back(slab);
+        }
+        // in front, so that slabs.back() stays the slab this pool is filling
+        slabs.insert(slabs.begin(), added.begin(), added.end());
+    }
+
+    friend bool operator== (const NodePool &x, const NodePool &y) { return &x == &y; }
+    friend bool operator!= (const NodePool &x, const NodePool &y) { return &x != &y; }
+
+private:
+    union Slot {
+        Slot *next;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    void grow() {
+        capacity = capacity == 0 ? 64 : min<size_t>(capacity * 2, 65536);
+        slabs.emplace_back(static_cast<Slot*>(::operator new(capacity * sizeof(Slot))), [](Slot *slab) { ::operator delete(slab); });
+        used = 0;
+    }
+
+    vector<shared_ptr<Slot>> slabs;
+    Slot *free_list = nullptr;
+    size_t used = 0, capacity = 0;
+};
+
+template <typename A, typename = void>
+struct HasRelease: false_type {};
+template <typename A>
+struct HasRelease<A, void_t<decltype(declval<A&>().release())>>: true_type {};
+
+/**
+ * Augmentation policies for RBTree: Data lives in every node and pull(node) recomputes it
+ * from node->kv and both children. RBTree pulls after every rotation and along the changed
+ * path on insert / erase, so each node always describes its own subtree.
+*/
+struct NoAugment {
+    static constexpr bool ENABLED = false;
+    static constexpr bool HAS_SIZE = false;
+    struct Data {};
+    template <typename Node> static void pull(Node*) {}
+};
+
+// subtree size, enables select() and rank()
+struct SizeAugment {
+    static constexpr bool ENABLED = true;
+    static constexpr bool HAS_SIZE = true;
+    struct Data { size_t size = 1; };
+
+    template <typename Node>
+    static void pull(Node *node) {
+        node->aug.size = 1 + (node->left ? node->left->aug.size : 0) + (node->right ? node->right->aug.size : 0);
+    }
+};
+
+/**
+ * Subtree size plus a fold of the values in key order, enables aggregate(lo, hi).
+ * Monoid provides `type`, `identity()`, `combine(a, b)` (associative, not necessarily commutative)
+ * and `from(value)`.
+*/
+template <typename Monoid>
+struct MonoidAugment {
+    static constexpr bool ENABLED = true;
+    static constexpr bool HAS_SIZE = true;
+    using Type = typename Monoid::type;
+    struct Data { size_t size = 1; Type sum = Monoid::identity(); };
+
+    template <typename Node>
+    static void pull(Node *node) {
+        node->aug.size = 1 + (node->left ? node->left->aug.size : 0) + (node->right ? node->right->aug.size : 0);
+        node->aug.sum = Monoid::combine(Monoid::combine(sum(node->left), lift(node)), sum(node->right));
+    }
+
+    template <typename Node>
+    static Type sum(const Node *node) {
+        return node != nullptr ? node->aug.sum : Monoid::identity();
+    }
+
+    template <typename Node>
+    static Type lift(const Node *node) { return Monoid::from(node->value()); }
+
+    static Type identity() { return Monoid::identity(); }
+    static Type combine(const Type &a, const Type &b) { return Monoid::combine(a, b); }
+};
+
+template <typename T>
+struct SumMonoid {
+    using type = T;
+    static T identity() { return T(); }
+    static T combine(const T &a, const T &b) { return a + b; }
+    static T from(const T &v) { return v; }
+};
+
+/**
+ * Stats policies for RBTree: the tree calls the hooks below from its rebalancing code and compares
+ * keys through Comparator<Compare>. NoStats hooks are empty and Comparator is Compare itself,
+ * so a tree without stats compiles to the same code as before.
+*/
+struct NoStats {
+    static constexpr bool ENABLED = false;
+    template <typename Compare> using Comparator = Compare;
+
+    void rotation() {}
+    void insertFixup() {}
+    void recolor() {}
+    void removeFixup() {}
+    void insertBegin() {}
+    void insertEnd() {}
+};
+
+/**
+ * Counts rotations, insert fix-ups and the Case 4 recolor steps each one cascades through,
+ * BLACK-deficit fix-ups on erase, and comparator calls (in total and inside insert / emplace).
+*/
+struct RBTreeStats {
+    static constexpr bool ENABLED = true;
+
+    template <typename Compare>
+    struct Comparator {
+        template <typename A, typename B>
+        bool operator() (const A &a, const B &b) const {
+            ++*calls;
+            return cmp(a, b);
+        }
+
+        Compare cmp;
+        uint64_t *calls = nullptr;
+    };
+
+    void rotation() { ++rotations; }
+    void insertFixup() { ++insert_fixups; cascade = 0; }
+    void recolor() {
+        ++recolors;
+        max_cascade = max(max_cascade, ++cascade);
+    }
+    void removeFixup() { ++remove_fixups; }
+    void insertBegin() { ++inserts; insert_start = comparisons; }
+    void insertEnd() { insert_comparisons += comparisons - insert_start; }
+
+    // the counters as JSON object members, without the braces
+    string json_fields() const {
+        return "\"inserts\":" + to_string(inserts) + ",\"comparisons\":" + to_string(comparisons)
+            + ",\"insert_comparisons\":" + to_string(insert_comparisons)
+            + ",\"rotations\":" + to_string(rotations) + ",\"insert_fixups\":" + to_string(insert_fixups)
+            + ",\"recolors\":" + to_string(recolors) + ",\"max_recolor_cascade\":" + to_string(max_cascade)
+            + ",\"remove_fixups\":" + to_string(remove_fixups);
+    }
+
+    uint64_t inserts = 0, comparisons = 0, insert_comparisons = 0;
+    uint64_t rotations = 0, insert_fixups = 0, recolors = 0, max_cascade = 0, remove_fixups = 0;
+
+private:
+    uint64_t cascade = 0, insert_start = 0;
+};
+
+/**
+ * On-disk image of an RBTree: this header, then the keys in order and the values in the same order,
+ * each section starting on a 64-byte boundary. Only trivially copyable K and V can be stored.
+*/
+struct RBTreeFileHeader {
+    static const uint32_t VERSION = 1;
+    static const int ALIGN = 64;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t key_bytes;
+    uint32_t value_bytes;
+    uint32_t reserved;
+    uint64_t size;
+    uint64_t keys_offset;
+    uint64_t values_offset;
+
+    static RBTreeFileHeader make(uint32_t key_bytes, uint32_t value_bytes, uint64_t size) {
+        RBTreeFileHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "RBTREE\0\0", 8);
+        header.version = VERSION;
+        header.key_bytes = key_bytes;
+        header.value_bytes = value_bytes;
+        header.size = size;
+        header.keys_offset = align(sizeof(header));
+        header.values_offset = align(header.keys_offset + size * key_bytes);
+        return header;
+    }
+
+    bool valid(uint32_t expected_key_bytes, uint32_t expected_value_bytes, uint64_t file_bytes) const {
+        return memcmp(magic, "RBTREE\0\0", 8) == 0 && version == VERSION &&
+            key_bytes == expected_key_bytes && value_bytes == expected_value_bytes &&
+            keys_offset % ALIGN == 0 && values_offset % ALIGN == 0 &&
+            size <= file_bytes && keys_offset + size * key_bytes <= file_bytes &&
+            values_offset + size * value_bytes <= file_bytes;
+    }
+
+    static uint64_t align(uint64_t offset) {
+        return (offset + ALIGN - 1) / ALIGN * ALIGN;
+    }
+};
+
+/**
+ * Read-only map served straight from a file written by RBTree::save(): lookups binary search
+ * the mapped key array, nothing is copied or rebuilt, pages fault in as they are touched.
+*/
 template<class K, class V, class Compare = less<K>>
+class MappedRBTree {
+public:
+    explicit MappedRBTree(const string &path) {
+        static_assert(is_trivially_copyable_v<K> && is_trivially_copyable_v<V>, "only trivially copyable entries can be mapped");
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw runtime_error("cannot open: " + path);
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(RBTreeFileHeader)) {
+            close(fd);
+            throw runtime_error("not an rb_tree file: " + path);
+        }
+        mapped_bytes = st.st_size;
+        mapped = mmap(nullptr, mapped_bytes, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED) throw runtime_error("mmap failed: " + path);
+
+        const RBTreeFileHeader &header = *(const RBTreeFileHeader*)mapped;
+        if (!header.valid(sizeof(K), sizeof(V), mapped_bytes)) {
+            munmap(mapped, mapped_bytes);
+            throw runtime_error("incompatible or truncated rb_tree file: " + path);
+        }
+        const char *base = (const char*)mapped;
+        count = header.size;
+        keys = (const K*)(base + header.keys_offset);
+        values = (const V*)(base + header.values_offset);
+    }
+
+    MappedRBTree(const MappedRBTree&) = delete;
+    MappedRBTree& operator= (const MappedRBTree&) = delete;
+
+    ~MappedRBTree() {
+        munmap(mapped, mapped_bytes);
+    }
+
+    struct ConstIterator {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using difference_type   = std::ptrdiff_t;
+        using value_type        = pair<K, V>;
+        // keys and values are stored apart, so entries come out as a pair of references
+        using reference         = pair<const K&, const V&>;
+        struct pointer {
+            reference ref;
+            const reference* operator-> () const { return &ref; }
+        };
+
+        ConstIterator(): tree(nullptr), index(0) {}
+        ConstIterator(const MappedRBTree *t, size_t i): tree(t), index(i) {}
+
+        reference operator* () const { return reference(tree->keys[index], tree->values[index]); }
+        pointer operator-> () const { return pointer{operator*()}; }
+        ConstIterator& operator++ () { ++index; return *this; }
+        ConstIterator operator++ (int) { return ConstIterator(tree, index++); }
+        ConstIterator& operator-- () { --index; return *this; }
+        ConstIterator operator-- (int) { return ConstIterator(tree, index--); }
+        ConstIterator& operator+= (difference_type d) { index += d; return *this; }
+        ConstIterator operator+ (difference_type d) const { return ConstIterator(tree, index + d); }
+        difference_type operator- (const ConstIterator &o) const { return difference_type(index) - difference_type(o.index); }
+
+        friend bool operator== (const ConstIterator &x, const ConstIterator &y) { return x.index == y.index; }
+        friend bool operator!= (const ConstIterator &x, const ConstIterator &y) { return x.index != y.index; }
+
+    private:
+        const MappedRBTree *tree;
+        size_t index;
+    };
+
+    size_t size() const noexcept { return count; }
+    bool empty() const noexcept { return count == 0; }
+
+    ConstIterator find(const K &k) const {
+        size_t i = lowerIndex(k);
+        return i < count && !cmp(k, keys[i]) ? ConstIterator(this, i) : end();
+    }
+    bool contains(const K &k) const { return find(k) != end(); }
+
+    // first key >= k
+    ConstIterator lower_bound(const K &k) const { return ConstIterator(this, lowerIndex(k)); }
+
+    // first key > k
+    ConstIterator upper_bound(const K &k) const { return ConstIterator(this, std::upper_bound(keys, keys + count, k, cmp) - keys); }
+
+    ConstIterator begin() const { return ConstIterator(this, 0); }
+    ConstIterator end() const { return ConstIterator(this, count); }
+
+private:
+    size_t lowerIndex(const K &k) const {
+        return std::lower_bound(keys, keys + count, k, cmp) - keys;
+    }
+
+    void *mapped;
+    size_t mapped_bytes;
+    size_t count;
+    const K *keys;
+    const V *values;
+    Compare cmp;
+};
+
+template<class K, class V, class Compare = less<K>, class Alloc = NodePool<pair<K, V>>, class Augment = NoAugment, class Stats = NoStats>
 class RBTree {
 public:
-    RBTree(): root(nullptr) {}
+    RBTree(): root(nullptr) {
+        if constexpr (Stats::ENABLED) cmp.calls = &counters.comparisons;
+    }
+    RBTree(const RBTree&) = delete;
+    RBTree& operator= (const RBTree&) = delete;
+
     virtual ~RBTree() {
-        if (root != nullptr) delete root;
+        clear();
     }
 
-    void insert(const K &k, const V &v) {
-        if (this->root == nullptr) this->root = new Node(nullptr, k, v);
-        else insert(root, k, v);
+    struct Node;
+    template <bool IsConst> struct BasicIterator;
+    using Iterator = BasicIterator<false>;
+    using ConstIterator = BasicIterator<true>;
+
+    size_t size() const noexcept { return this->count; }
+    bool empty() const noexcept { return this->root == nullptr; }
+
+    /**
+     * Inserts, or overwrites the value if k is already there. k and v are forwarded, so each one is
+     * moved or copied into the node on its own; a key of another type is converted to K once, up front.
+    */
+    template <typename KK, typename VV,
+        typename = enable_if_t<is_constructible_v<K, KK&&> && is_constructible_v<V, VV&&>>>
+    Iterator insert(KK &&k, VV &&v) {
+        counters.insertBegin();
+        Node *node;
+        if constexpr (is_same_v<decay_t<KK>, K>) node = put(std::forward<KK>(k), std::forward<VV>(v));
+        else node = put(K(std::forward<KK>(k)), std::forward<VV>(v));
+        counters.insertEnd();
+        return Iterator(node, this);
+    }
+
+    // builds the pair<K, V> in its node from args, then links it like insert(), overwriting an equal key's value
+    template <typename... Args>
+    Iterator emplace(Args&&... args) {
+        counters.insertBegin();
+        Node *node = emplaceNode(createNode(nullptr, std::forward<Args>(args)...));
+        counters.insertEnd();
+        return Iterator(node, this);
+    }
+
+    /**
+     * Insert as close as possible to hint, which is either the position right after k or right before it.
+     * A correct hint skips the descent, e.g. `it = tree.insert(it, k, v)` or `tree.insert(tree.end(), k, v)`
+     * over ascending keys attaches each node next to the previous one, O(1) amortized with rebalancing.
+     * A wrong hint falls back to a normal insert.
+    */
+    Iterator insert(Iterator hint, const K &k, const V &v) {
+        counters.insertBegin();
+        Node *node = putNear(hint.ptr, k, v);
+        counters.insertEnd();
+        return Iterator(node, this);
+    }
+
+    // removes the node at pos and returns the one after it, no search needed
+    Iterator erase(Iterator pos) {
+        Node *node = pos.ptr;
+        assert(node != nullptr);
+        Node *next = node->next();
+        removeNode(node);
+        return Iterator(next, this);
+    }
+
+    Iterator erase(Iterator first, Iterator last) {
+        while (first != last) first = erase(first);
+        return last;
+    }
+
+    size_t erase(const K &k) {
+        Node *node = findNode(k);
+        if (node == nullptr) return 0;
+        removeNode(node);
+        return 1;
+    }
+
+    Iterator find(const K &k) { return Iterator(findNode(k), this); }
+    ConstIterator find(const K &k) const { return ConstIterator(findNode(k), this); }
+    bool contains(const K &k) const { return findNode(k) != nullptr; }
+
+    // first key >= k
+    Iterator lower_bound(const K &k) { return Iterator(lowerBoundNode(k), this); }
+    ConstIterator lower_bound(const K &k) const { return ConstIterator(lowerBoundNode(k), this); }
+
+    // first key > k
+    Iterator upper_bound(const K &k) { return Iterator(upperBoundNode(k), this); }
+    ConstIterator upper_bound(const K &k) const { return ConstIterator(upperBoundNode(k), this); }
+
+    // the i-th smallest entry (0-based), end() if i >= size(); needs a sized Augment
+    ConstIterator select(size_t i) const {
+        static_assert(Augment::HAS_SIZE, "select() needs SizeAugment or MonoidAugment");
+        Node *node = root;
+        while (node != nullptr) {
+            size_t left = subtreeSize(node->left);
+            if (i < left) {
+                node = node->left;
+            }
+            else if (i == left) {
+                return ConstIterator(node, this);
+            }
+            else {
+                i -= left + 1;
+                node = node->right;
+            }
+        }
+        return end();
+    }
+
+    // number of keys < k; needs a sized Augment
+    size_t rank(const K &k) const {
+        static_assert(Augment::HAS_SIZE, "rank() needs SizeAugment or MonoidAugment");
+        size_t r = 0;
+        Node *node = root;
+        while (node != nullptr) {
+            if (cmp(node->key(), k)) {
+                r += subtreeSize(node->left) + 1;
+                node = node->right;
+            }
+            else {
+                node = node->left;
+            }
+        }
+        return r;
+    }
+
+    /**
+     * Fold of the values with lo <= key < hi in key order; needs MonoidAugment.
+     * Descend to the first node inside the range, then fold the keys >= lo of its left subtree
+     * and the keys < hi of its right subtree, adding whole subtrees on the way down.
+    */
+    template <typename M = Augment>
+    typename M::Type aggregate(const K &lo, const K &hi) const {
+        Node *split = root;
+        while (split != nullptr) {
+            if (cmp(split->key(), lo)) split = split->right;
+            else if (!cmp(split->key(), hi)) split = split->left;
+            else break;
+        }
+        if (split == nullptr) return M::identity();
+
+        auto left = M::identity();
+        for (Node *node = split->left; node != nullptr; ) {
+            if (cmp(node->key(), lo)) {
+                node = node->right;
+            }
+            else {
+                left = M::combine(M::combine(M::lift(node), M::sum(node->right)), left);
+                node = node->left;
+            }
+        }
+        auto right = M::identity();
+        for (Node *node = split->right; node != nullptr; ) {
+            if (cmp(node->key(), hi)) {
+                right = M::combine(right, M::combine(M::sum(node->left), M::lift(node)));
+                node = node->right;
+            }
+            else {
+                node = node->left;
+            }
+        }
+        return M::combine(M::combine(left, M::lift(split)), right);
+    }
+
+    /**
+     * With a pool allocator and trivially destructible nodes (key, value and augmented data), the whole
+     * pool is dropped in O(1) per slab.
+     * Otherwise nodes are freed in an iterative post-order walk along parent pointers, no recursion.
+    */
+    void clear() {
+        leftmost = rightmost = nullptr;
+        count = 0;
+        if constexpr (HasRelease<NodeAlloc>::value && is_trivially_destructible_v<Node>) {
+            alloc.release();
+            root = nullptr;
+            return;
+        }
+
+        destroySubtree(root);
+        root = nullptr;
+    }
+
+    /**
+     * Replace the contents with a sorted range of (key, value) pairs in O(n). The tree is built balanced
+     * straight away: every level BLACK except a partial last one, which is RED. Runs of equal keys keep
+     * the last value, as repeated insert() would.
+    */
+    template <typename It>
+    void assign_sorted(It first, It last) {
+        clear();
+        size_t n = 0;
+        for (It it = first; it != last; ) {
+            It run = it;
+            for (++it; it != last && !cmp(run->first, it->first); ++it) {}
+            ++n;
+        }
+        int red_depth = 0;
+        while ((size_t(2) << red_depth) <= n + 1) ++red_depth;
+        root = buildSorted(first, last, n, 0, red_depth, nullptr);
+        count = n;
+        resetEnds();
+    }
+
+    /**
+     * Move every entry with key >= k into other, which must be empty, in O(log n). Without a sized Augment
+     * the two sizes cost O(min(left, right)) on top: both halves are walked in step until the smaller ends.
+     * With a NodePool both trees keep the shared slabs alive until both are gone.
+    */
+    void split(const K &k, RBTree &other) {
+        assert(other.empty());
+        if constexpr (HasRelease<NodeAlloc>::value) other.alloc.share(alloc);
+        Node *l, *m, *r;
+        int ht = rootHeight(root), hl, hr;
+        splitRoots(detach(root), ht, k, l, hl, m, r, hr);
+        if (m != nullptr) r = joinRoots(nullptr, 0, m, r, hr, hr);
+        root = l;
+        other.root = r;
+        resetEnds();
+        other.resetEnds();
+        if constexpr (Augment::HAS_SIZE) {
+            count = subtreeSize(root);
+            other.count = subtreeSize(other.root);
+        }
+        else {
+            size_t total = count, seen = 0;
+            const Node *a = leftmost, *b = other.leftmost;
+            for (; a != nullptr && b != nullptr; a = a->next(), b = b->next()) ++seen;
+            count = a == nullptr ? seen : total - seen;
+            other.count = total - count;
+        }
+    }
+
+    // append other, whose keys all have to be greater than the keys here, in O(log n); other ends up empty
+    void join(RBTree &other) {
+        assert(empty() || other.empty() || cmp(rightmost->key(), other.leftmost->key()));
+        Node *a = root, *b = other.root;
+        int ha = rootHeight(a), hb = rootHeight(b), h;
+        absorb(other, joinTwo(detach(a), ha, detach(b), hb, h), 0);
+    }
+
+    /**
+     * Set operations in O(m log(n / m + 1)) for trees of sizes m <= n, recursing on split and join
+     * so no entry is rebalanced one by one. Each one consumes other, which ends up empty.
+    */
+    // keys of either tree, other's value wins on equal keys
+    void unite(RBTree &other) {
+        size_t dropped = 0;
+        Node *a = root, *b = other.root;
+        int ha = rootHeight(a), hb = rootHeight(b), h;
+        Node *result = uniteRoots(detach(a), ha, detach(b), hb, h, dropped);
+        absorb(other, result, dropped);
+    }
+
+    // keys of both trees, with the values here
+    void intersect(RBTree &other) {
+        size_t dropped = 0;
+        Node *a = root, *b = other.root;
+        int ha = rootHeight(a), hb = rootHeight(b), h;
+        Node *result = intersectRoots(detach(a), ha, detach(b), hb, h, dropped);
+        absorb(other, result, dropped);
+    }
+
+    // keys here that are not in other
+    void subtract(RBTree &other) {
+        size_t dropped = 0;
+        Node *a = root, *b = other.root;
+        int ha = rootHeight(a), hb = rootHeight(b), h;
+        Node *result = subtractRoots(detach(a), ha, detach(b), hb, h, dropped);
+        absorb(other, result, dropped);
+    }
+
+    /**
+     * Write a sorted image for MappedRBTree or load(): keys then values, streamed in two in-order
+     * walks through a buffered file, so nothing beyond the tree itself is held in memory.
+    */
+    void save(const string &path) const {
+        static_assert(is_trivially_copyable_v<K> && is_trivially_copyable_v<V>, "only trivially copyable entries can be saved");
+        RBTreeFileHeader header = RBTreeFileHeader::make(sizeof(K), sizeof(V), size());
+        ofstream out(path, ios::binary | ios::trunc);
+        if (!out) throw runtime_error("cannot open for writing: " + path);
+        static const char zeros[RBTreeFileHeader::ALIGN] = {};
+        out.write((const char*)&header, sizeof(header));
+        out.write(zeros, header.keys_offset - sizeof(header));
+        for (const Node *node = leftmost; node != nullptr; node = node->next()) {
+            out.write((const char*)&node->kv.first, sizeof(K));
+        }
+        out.write(zeros, header.values_offset - header.keys_offset - header.size * sizeof(K));
+        for (const Node *node = leftmost; node != nullptr; node = node->next()) {
+            out.write((const char*)&node->kv.second, sizeof(V));
+        }
+        if (!out) throw runtime_error("write failed: " + path);
+    }
+
+    // replace the contents with a saved image, rebuilt in O(n) by assign_sorted()
+    void load(const string &path) {
+        MappedRBTree<K, V, Compare> image(path);
+        assign_sorted(image.begin(), image.end());
+    }
+
+    const Stats& stats() const noexcept { return counters; }
+
+    // nodes on the longest root-to-leaf path, at most 2 * log2(n + 1) in a valid tree
+    int height() const { return nodeHeight(root); }
+
+    // counters plus the shape of the tree, one JSON object; needs a Stats policy that counts
+    string stats_json() const {
+        static_assert(Stats::ENABLED, "stats_json() needs RBTreeStats");
+        size_t n = size();
+        return "{\"size\":" + to_string(n) + ",\"height\":" + to_string(height())
+            + ",\"height_bound\":" + to_string(2 * log2(n + 1.0)) + "," + counters.json_fields() + "}";
+    }
+
+    /**
+     * Check every red-black and bookkeeping invariant in O(n): parent links, no RED node with a RED child,
+     * the same black height on every path, strictly ascending keys, leftmost / rightmost, the size and the
+     * augmented size. Returns false and describes the first violation in error if one is given.
+     * Keys are compared with the tree's comparator, so a counting Stats sees these calls too.
+    */
+    bool validate(string *error = nullptr) const {
+        auto fail = [error](const string &why) {
+            if (error != nullptr) *error = why;
+            return false;
+        };
+        if (root == nullptr) {
+            if (leftmost != nullptr || rightmost != nullptr) return fail("empty tree with leftmost / rightmost set");
+            if (count != 0) return fail("empty tree with size " + to_string(count));
+            return true;
+        }
+        if (root->parent != nullptr) return fail("root has a parent");
+
+        size_t n = 0;
+        int black = validateSubtree(root, nullptr, nullptr, n, error);
+        if (black < 0) return false;
+        const Node *first = root, *last = root;
+        while (first->left != nullptr) first = first->left;
+        while (last->right != nullptr) last = last->right;
+        if (first != leftmost || last != rightmost) return fail("leftmost / rightmost out of date");
+        if (count != n) return fail("size " + to_string(count) + " but " + to_string(n) + " nodes");
+        if (height() > 2 * log2(n + 1.0)) return fail("height " + to_string(height()) + " above 2 * log2(n + 1)");
+        return true;
     }
 
     string to_graphviz() {
@@ -37,12 +755,8 @@ public:
         enum Dir { LEFT = -1, ROOT = 0, RIGHT = 1};
         enum Color { RED, BLACK };
 
-        Node(Node *p, const K &k, const V &v): parent(p), kv(k, v), left(nullptr), right(nullptr) {}
-
-        virtual ~Node() {
-            if (left != nullptr) delete left;
-            if (right != nullptr) delete right;
-        }
+        template <typename... Args>
+        Node(Node *p, Args&&... args): kv(std::forward<Args>(args)...), parent(p), left(nullptr), right(nullptr) {}
 
         inline const K& key() const noexcept { return this->kv.first; }
         inline const V& value() const noexcept { return this->kv.second; }
@@ -57,8 +771,8 @@ public:
         inline Node* grandParent() const noexcept { return this->parent == nullptr ? nullptr : this->parent->parent; }
         inline Dir dir() const noexcept { return this->parent == nullptr ? ROOT : (this == this->parent->left ? LEFT : RIGHT); }
 
-        Node* next() {
-            Node *node = this;
+        Node* next() const {
+            Node *node = const_cast<Node*>(this);
             if (node->right != nullptr) {
                 node = node->right;
                 while (node->left != nullptr) node = node->left;
@@ -70,8 +784,8 @@ public:
             return node;
         }
 
-        Node* prev() {
-            Node *node = this;
+        Node* prev() const {
+            Node *node = const_cast<Node*>(this);
             if (node->left != nullptr) {
                 node = node->left;
                 while (node->right != nullptr) node = node->right;
@@ -97,144 +811,632 @@ public:
         pair<K, V> kv;
         Node *parent, *left, *right;
         Color color = RED;
+        typename Augment::Data aug;
     };
 
-    struct Iterator 
+    template <bool IsConst>
+    struct BasicIterator 
     {
     public:
-        Iterator(): ptr(nullptr) {}
-        Iterator(Node *p): ptr(p) {}
-        Iterator(const Iterator &iter): ptr(iter.ptr) {}
+        using NodePtr = conditional_t<IsConst, const Node*, Node*>;
+        BasicIterator(): ptr(nullptr), tree(nullptr) {}
+        BasicIterator(NodePtr p, const RBTree *t): ptr(p), tree(t) {}
+        BasicIterator(const BasicIterator &iter): ptr(iter.ptr), tree(iter.tree) {}
+        template <bool C, typename = enable_if_t<IsConst && !C>>
+        BasicIterator(const BasicIterator<C> &iter): ptr(iter.ptr), tree(iter.tree) {}
+        BasicIterator& operator= (const BasicIterator &iter) = default;
         using iterator_category = std::bidirectional_iterator_tag;
         using difference_type   = std::ptrdiff_t;
         using value_type        = pair<K, V>;
-        using pointer           = value_type*;
-        using reference         = value_type&;
+        using pointer           = conditional_t<IsConst, const value_type*, value_type*>;
+        using reference         = conditional_t<IsConst, const value_type&, value_type&>;
 
         reference operator* () const { return ptr->kv; }
         pointer operator-> () const { return &(operator*()); }
-        Iterator& operator++ () {
+        BasicIterator& operator++ () {
             ptr = ptr->next();
             return *this;
         }
-        Iterator operator++ (int) {
-            Iterator tmp = *this;
+        BasicIterator operator++ (int) {
+            BasicIterator tmp = *this;
             ptr = ptr->next();
             return tmp;
         }
 
-        Iterator& operator-- () {
-            ptr = ptr->prev();
+        // --end() is the last entry
+        BasicIterator& operator-- () {
+            ptr = ptr == nullptr ? tree->rightmost : ptr->prev();
             return *this;
         }
-        Iterator operator-- (int) {
-            Iterator tmp = *this;
-            ptr = ptr->prev();
+        BasicIterator operator-- (int) {
+            BasicIterator tmp = *this;
+            --*this;
             return tmp;
         }
 
-        friend bool operator== (const Iterator &x, const Iterator &y) {
+        friend bool operator== (const BasicIterator &x, const BasicIterator &y) {
             return x.ptr == y.ptr;
         }
 
-        friend bool operator!= (const Iterator &x, const Iterator &y) {
+        friend bool operator!= (const BasicIterator &x, const BasicIterator &y) {
             return x.ptr != y.ptr;
         }
 
     private:
-        Node *ptr;
+        friend class RBTree;
+        template <bool> friend struct BasicIterator;
+        NodePtr ptr;
+        const RBTree *tree;
     };
 
     Iterator begin() {
-        Node *node = root;
-        while (node != nullptr && node->left != nullptr) node = node->left;
-        return Iterator(node);
+        return Iterator(leftmost, this);
     }
 
     Iterator end() {
-        return Iterator(nullptr);
+        return Iterator(nullptr, this);
+    }
+
+    ConstIterator begin() const {
+        return ConstIterator(leftmost, this);
+    }
+
+    ConstIterator end() const {
+        return ConstIterator(nullptr, this);
     }
 
+    ConstIterator cbegin() const { return begin(); }
+    ConstIterator cend() const { return end(); }
+
 private:
     using Dir = typename Node::Dir;
     using Color = typename Node::Color;
+    using NodeAlloc = typename allocator_traits<Alloc>::template rebind_alloc<Node>;
+    using NodeTraits = allocator_traits<NodeAlloc>;
 
-    void insert(Node *node, const K &k, const V &v) {
-        int c = cmp(k, node->key()) ? -1 : (cmp(node->key(), k) ? 1 : 0);
-        if (c == 0) {
-            node->kv = make_pair(k, v);
-        }
-        else if (c < 1) {
-            if (node->left == nullptr) {
-                node->left = new Node(node, k, v);
-                maintainAfterInsert(node->left);
+    template <typename... Args>
+    Node* createNode(Node *parent, Args&&... args) {
+        Node *node = NodeTraits::allocate(alloc, 1);
+        NodeTraits::construct(alloc, node, parent, std::forward<Args>(args)...);
+        return node;
+    }
+
+    void destroyNode(Node *node) {
+        NodeTraits::destroy(alloc, node);
+        NodeTraits::deallocate(alloc, node, 1);
+    }
+
+    /**
+     * One pass down: at each level remember the node and the side taken, so the new node hangs
+     * under the last one without looking at it again. k and v are only copied or moved into the node.
+    */
+    template <typename KK, typename VV>
+    Node* put(KK &&k, VV &&v) {
+        Node *parent = nullptr;
+        Dir dir = Dir::ROOT;
+        for (Node *node = root; node != nullptr; ) {
+            parent = node;
+            if (cmp(k, node->key())) {
+                dir = Dir::LEFT;
+                node = node->left;
+            }
+            else if (cmp(node->key(), k)) {
+                dir = Dir::RIGHT;
+                node = node->right;
             }
             else {
-                insert(node->left, k, v);
+                node->kv.second = std::forward<VV>(v);
+                pullUp(node);
+                return node;
             }
         }
-        else {
-            if (node->right == nullptr) {
-                node->right = new Node(node, k, v);
-                maintainAfterInsert(node->right);
+        return attach(parent, dir, std::forward<KK>(k), std::forward<VV>(v));
+    }
+
+    // link a node built by emplace(), or move its value onto an equal key's node
+    Node* emplaceNode(Node *node) {
+        Node *parent = nullptr;
+        Dir dir = Dir::ROOT;
+        for (Node *cur = root; cur != nullptr; ) {
+            parent = cur;
+            if (cmp(node->key(), cur->key())) {
+                dir = Dir::LEFT;
+                cur = cur->left;
+            }
+            else if (cmp(cur->key(), node->key())) {
+                dir = Dir::RIGHT;
+                cur = cur->right;
             }
             else {
-                insert(node->right, k, v);
+                cur->kv.second = std::move(node->kv.second);
+                destroyNode(node);
+                pullUp(cur);
+                return cur;
             }
         }
+        return link(parent, dir, node);
     }
 
-    void rotateLeft(Node *node) {
-        // clang-format off
-        //     |                       |
-        //     N                       R
-        //    / \     l-rotate(N)     / \
-        //   L   R    ==========>    N   RR
-        //      / \                 / \
-        //    RL   RR              L   RL
-        // clang-format on
-
-        assert(node != nullptr && node->right != nullptr);
-            
-        Node* parent = node->parent;
-        Dir dir = node->dir();
+    // the hinted insert, see insert(hint, k, v)
+    Node* putNear(Node *h, const K &k, const V &v) {
+        if (this->root == nullptr) return put(k, v);
 
-        Node* r = node->right;
-        node->right = r->left;
-        r->left = node;
-        r->parent = parent;
+        if (h == nullptr) {
+            if (cmp(rightmost->key(), k)) return attach(rightmost, Dir::RIGHT, k, v);
+        }
+        else if (cmp(k, h->key())) {
+            // k goes right before h
+            if (h == leftmost) return attach(h, Dir::LEFT, k, v);
+            Node *p = h->prev();
+            if (cmp(p->key(), k)) {
+                return h->left == nullptr ? attach(h, Dir::LEFT, k, v) : attach(p, Dir::RIGHT, k, v);
+            }
+        }
+        else if (cmp(h->key(), k)) {
+            // k goes right after h
+            if (h == rightmost) return attach(h, Dir::RIGHT, k, v);
+            Node *n = h->next();
+            if (cmp(k, n->key())) {
+                return h->right == nullptr ? attach(h, Dir::RIGHT, k, v) : attach(n, Dir::LEFT, k, v);
+            }
+        }
+        else {
+            h->kv = make_pair(k, v);
+            pullUp(h);
+            return h;
+        }
+        return put(k, v);
+    }
 
-        updateMyChildrensParent(node);
-        updateMyChildrensParent(r);
+    template <typename... Args>
+    Node* attach(Node *parent, Dir dir, Args&&... args) {
+        return link(parent, dir, createNode(parent, std::forward<Args>(args)...));
+    }
 
+    // hang a new node under parent (or as root) and rebalance
+    Node* link(Node *parent, Dir dir, Node *node) {
+        node->parent = parent;
+        ++count;
         switch (dir) {
-            case Node::ROOT: this->root = r; break;
-            case Node::LEFT: parent->left = r; break;
-            case Node::RIGHT: parent->right = r; break;
+            case Dir::ROOT:
+                root = leftmost = rightmost = node;
+                break;
+            case Dir::LEFT:
+                assert(parent->left == nullptr);
+                parent->left = node;
+                if (parent == leftmost) leftmost = node;
+                break;
+            case Dir::RIGHT:
+                assert(parent->right == nullptr);
+                parent->right = node;
+                if (parent == rightmost) rightmost = node;
+                break;
         }
+        // fix the whole path first, rotations below keep each subtree's summary intact
+        pullUp(node);
+        maintainAfterInsert(node);
+#ifdef RB_TREE_VALIDATE
+        assert(validate());
+#endif
+        return node;
     }
 
-    void rotateRight(Node *node) {
-        // clang-format off
-        //       |                   |
-        //       N                   L
-        //      / \   r-rotate(N)   / \
-        //     L   R  ==========> LL   N
-        //    / \                     / \
-        //  LL   LR                 LR   R
-        // clang-format on
-        assert(node != nullptr && node->left != nullptr);
+    // recompute augmented data from node up to the root, free when there is none
+    void pullUp(Node *node) {
+        if constexpr (Augment::ENABLED) {
+            for (; node != nullptr; node = node->parent) Augment::pull(node);
+        }
+    }
 
-        Node *parent = node->parent;
-        Dir dir = node->dir();
+    static size_t subtreeSize(const Node *node) {
+        return node != nullptr ? node->aug.size : 0;
+    }
 
-        Node *l = node->left;
+    // iterative post-order walk along parent pointers, returns the number of nodes freed
+    size_t destroySubtree(Node *node) {
+        size_t freed = 0;
+        if (node != nullptr) node->parent = nullptr;
+        while (node != nullptr) {
+            if (node->left != nullptr) {
+                node = node->left;
+            }
+            else if (node->right != nullptr) {
+                node = node->right;
+            }
+            else {
+                Node *parent = node->parent;
+                if (parent != nullptr) {
+                    if (parent->left == node) parent->left = nullptr;
+                    else parent->right = nullptr;
+                }
+                destroyNode(node);
+                ++freed;
+                node = parent;
+            }
+        }
+        return freed;
+    }
+
+    void resetEnds() {
+        leftmost = rightmost = root;
+        if (root == nullptr) return;
+        while (leftmost->left != nullptr) leftmost = leftmost->left;
+        while (rightmost->right != nullptr) rightmost = rightmost->right;
+    }
+
+    // take the nodes of other after a join or set operation built root out of both trees
+    void absorb(RBTree &other, Node *result, size_t dropped) {
+        if constexpr (HasRelease<NodeAlloc>::value) alloc.adopt(other.alloc);
+        if constexpr (Augment::HAS_SIZE) {
+            count = subtreeSize(result);
+        }
+        else {
+            count = count + other.count - dropped;
+        }
+        root = result;
+        other.root = other.leftmost = other.rightmost = nullptr;
+        other.count = 0;
+        resetEnds();
+    }
+
+    template <typename It>
+    Node* buildSorted(It &it, It last, size_t n, int depth, int red_depth, Node *parent) {
+        if (n == 0) return nullptr;
+        size_t half = (n - 1) / 2;
+        Node *left = buildSorted(it, last, half, depth + 1, red_depth, nullptr);
+        It run = it;
+        for (++it; it != last && !cmp(run->first, it->first); ++it) run = it;
+        assert(it == last || cmp(run->first, it->first));
+
+        Node *node = createNode(parent, run->first, run->second);
+        node->color = depth == red_depth ? Color::RED : Color::BLACK;
+        node->left = left;
+        if (left != nullptr) left->parent = node;
+        node->right = buildSorted(it, last, n - 1 - half, depth + 1, red_depth, node);
+        if constexpr (Augment::ENABLED) Augment::pull(node);
+        return node;
+    }
+
+    /**
+     * Join, split and the set operations work on detached subtrees: parent cut and root painted BLACK.
+     * They pass along each subtree's black height (NIL counts 0) so no join walks a spine to find it.
+    */
+    static Node* detach(Node *node) {
+        if (node != nullptr) {
+            node->parent = nullptr;
+            node->color = Color::BLACK;
+        }
+        return node;
+    }
+
+    // black height of a subtree once detached
+    static int rootHeight(const Node *node) {
+        if (node == nullptr) return 0;
+        int h = node->isRed();
+        for (; node != nullptr; node = node->left) h += node->isBlack();
+        return h;
+    }
+
+    // black height a child of a detached node of height h will have once detached itself
+    static int childHeight(int h, const Node *child) {
+        return h - 1 + (child != nullptr && child->isRed());
+    }
+
+    /**
+     * l < mid < r into one tree of height h. When the heights differ, mid goes RED down the spine of
+     * the taller one to the first BLACK node of the shorter one's height, then gets fixed up like an insert.
+    */
+    Node* joinRoots(Node *l, int hl, Node *mid, Node *r, int hr, int &h) {
+        detach(l);
+        detach(r);
+        mid->parent = mid->left = mid->right = nullptr;
+        mid->color = Color::RED;
+        if (hl == hr) {
+            mid->color = Color::BLACK;
+            mid->left = l;
+            mid->right = r;
+            updateMyChildrensParent(mid);
+            pullUp(mid);
+            h = hl + 1;
+            return mid;
+        }
+
+        Node *saved = root, *parent = nullptr;
+        if (hl > hr) {
+            Node *c = root = l;
+            for (int hc = hl; c != nullptr && !(c->isBlack() && hc == hr); c = c->right) {
+                hc -= c->isBlack();
+                parent = c;
+            }
+            mid->left = c;
+            mid->right = r;
+            parent->right = mid;
+        }
+        else {
+            Node *c = root = r;
+            for (int hc = hr; c != nullptr && !(c->isBlack() && hc == hl); c = c->left) {
+                hc -= c->isBlack();
+                parent = c;
+            }
+            mid->left = l;
+            mid->right = c;
+            parent->left = mid;
+        }
+        mid->parent = parent;
+        updateMyChildrensParent(mid);
+        pullUp(mid);
+        maintainAfterInsert(mid);
+
+        Node *result = root;
+        root = saved;
+        h = max(hl, hr) + result->isRed();
+        return result;
+    }
+
+    // l < r, by taking the last node of l out as the middle
+    Node* joinTwo(Node *l, int hl, Node *r, int hr, int &h) {
+        if (l == nullptr) { h = hr; return r; }
+        if (r == nullptr) { h = hl; return l; }
+        Node *last;
+        l = splitLast(l, hl, hl, last);
+        return joinRoots(l, hl, last, r, hr, h);
+    }
+
+    Node* splitLast(Node *t, int ht, int &h, Node *&last) {
+        Node *a = t->left, *b = t->right;
+        int ha = childHeight(ht, a), hb = childHeight(ht, b);
+        detach(a);
+        detach(b);
+        if (b == nullptr) {
+            last = t;
+            h = ha;
+            return a;
+        }
+        Node *x = splitLast(b, hb, hb, last);
+        return joinRoots(a, ha, t, x, hb, h);
+    }
+
+    // detached t into l < k, the node with key k (or nullptr) and r > k
+    void splitRoots(Node *t, int ht, const K &k, Node *&l, int &hl, Node *&m, Node *&r, int &hr) {
+        if (t == nullptr) {
+            l = m = r = nullptr;
+            hl = hr = 0;
+            return;
+        }
+        Node *a = t->left, *b = t->right, *x;
+        int ha = childHeight(ht, a), hb = childHeight(ht, b), hx;
+        detach(a);
+        detach(b);
+        if (cmp(k, t->key())) {
+            splitRoots(a, ha, k, l, hl, m, x, hx);
+            r = joinRoots(x, hx, t, b, hb, hr);
+        }
+        else if (cmp(t->key(), k)) {
+            splitRoots(b, hb, k, x, hx, m, r, hr);
+            l = joinRoots(a, ha, t, x, hx, hl);
+        }
+        else {
+            l = a, hl = ha;
+            r = b, hr = hb;
+            m = t;
+        }
+    }
+
+    Node* uniteRoots(Node *a, int ha, Node *b, int hb, int &h, size_t &dropped) {
+        if (a == nullptr) { h = hb; return b; }
+        if (b == nullptr) { h = ha; return a; }
+        Node *bl = b->left, *br = b->right, *l, *m, *r;
+        int hbl = childHeight(hb, bl), hbr = childHeight(hb, br), hl, hr;
+        splitRoots(a, ha, b->key(), l, hl, m, r, hr);
+        if (m != nullptr) {
+            destroyNode(m);
+            ++dropped;
+        }
+        l = uniteRoots(l, hl, detach(bl), hbl, hl, dropped);
+        r = uniteRoots(r, hr, detach(br), hbr, hr, dropped);
+        return joinRoots(l, hl, b, r, hr, h);
+    }
+
+    Node* intersectRoots(Node *a, int ha, Node *b, int hb, int &h, size_t &dropped) {
+        if (a == nullptr || b == nullptr) {
+            dropped += destroySubtree(a) + destroySubtree(b);
+            h = 0;
+            return nullptr;
+        }
+        Node *al = a->left, *ar = a->right, *l, *m, *r;
+        int hal = childHeight(ha, al), har = childHeight(ha, ar), hl, hr;
+        splitRoots(b, hb, a->key(), l, hl, m, r, hr);
+        l = intersectRoots(detach(al), hal, l, hl, hl, dropped);
+        r = intersectRoots(detach(ar), har, r, hr, hr, dropped);
+        if (m != nullptr) {
+            destroyNode(m);
+            ++dropped;
+            return joinRoots(l, hl, a, r, hr, h);
+        }
+        destroyNode(a);
+        ++dropped;
+        return joinTwo(l, hl, r, hr, h);
+    }
+
+    Node* subtractRoots(Node *a, int ha, Node *b, int hb, int &h, size_t &dropped) {
+        if (a == nullptr || b == nullptr) {
+            dropped += destroySubtree(b);
+            h = ha;
+            return a;
+        }
+        Node *al = a->left, *ar = a->right, *l, *m, *r;
+        int hal = childHeight(ha, al), har = childHeight(ha, ar), hl, hr;
+        splitRoots(b, hb, a->key(), l, hl, m, r, hr);
+        l = subtractRoots(detach(al), hal, l, hl, hl, dropped);
+        r = subtractRoots(detach(ar), har, r, hr, hr, dropped);
+        if (m != nullptr) {
+            destroyNode(m);
+            destroyNode(a);
+            dropped += 2;
+            return joinTwo(l, hl, r, hr, h);
+        }
+        return joinRoots(l, hl, a, r, hr, h);
+    }
+
+    Node* findNode(const K &k) const {
+        Node *node = lowerBoundNode(k);
+        return node != nullptr && !cmp(k, node->key()) ? node : nullptr;
+    }
+
+    Node* lowerBoundNode(const K &k) const {
+        Node *node = root, *ans = nullptr;
+        while (node != nullptr) {
+            if (cmp(node->key(), k)) {
+                node = node->right;
+            }
+            else {
+                ans = node;
+                node = node->left;
+            }
+        }
+        return ans;
+    }
+
+    Node* upperBoundNode(const K &k) const {
+        Node *node = root, *ans = nullptr;
+        while (node != nullptr) {
+            if (cmp(k, node->key())) {
+                ans = node;
+                node = node->left;
+            }
+            else {
+                node = node->right;
+            }
+        }
+        return ans;
+    }
+
+    void removeNode(Node *node) {
+        if (node == leftmost) leftmost = node->next();
+        if (node == rightmost) rightmost = node->prev();
+
+        if (node->left != nullptr && node->right != nullptr) {
+            // Two children: trade places with the successor, which has no left child.
+            // Nodes are relinked rather than swapping kv, so iterators to the successor stay valid.
+            Node *succ = node->right;
+            while (succ->left != nullptr) succ = succ->left;
+            swapWithSuccessor(node, succ);
+            // the path above node now holds node where succ was
+            pullUp(node);
+        }
+
+        Node *child = node->left != nullptr ? node->left : node->right;
+        if (child != nullptr) {
+            // Only child: node is BLACK and child is a RED leaf, child takes its place in BLACK.
+            replaceInParent(node, child);
+            child->color = Color::BLACK;
+        }
+        else {
+            // Leaf: a BLACK one leaves its path one BLACK short, fix that while it is still in place.
+            if (node->isBlack() && !node->isRoot()) maintainAfterRemove(node);
+            replaceInParent(node, nullptr);
+        }
+        pullUp(node->parent);
+
+        destroyNode(node);
+        --count;
+#ifdef RB_TREE_VALIDATE
+        assert(validate());
+#endif
+    }
+
+    void replaceInParent(Node *node, Node *child) {
+        switch (node->dir()) {
+            case Dir::ROOT: this->root = child; break;
+            case Dir::LEFT: node->parent->left = child; break;
+            case Dir::RIGHT: node->parent->right = child; break;
+        }
+        if (child != nullptr) child->parent = node->parent;
+    }
+
+    void swapWithSuccessor(Node *node, Node *succ) {
+        Node *succParent = succ->parent, *succRight = succ->right;
+        swap(node->color, succ->color);
+
+        replaceInParent(node, succ);
+        succ->left = node->left;
+        succ->left->parent = succ;
+        if (succParent == node) {
+            succ->right = node;
+            node->parent = succ;
+        }
+        else {
+            succ->right = node->right;
+            succ->right->parent = succ;
+            succParent->left = node;
+            node->parent = succParent;
+        }
+        node->left = nullptr;
+        node->right = succRight;
+        if (succRight != nullptr) succRight->parent = node;
+    }
+
+    void rotateLeft(Node *node) {
+        // clang-format off
+        //     |                       |
+        //     N                       R
+        //    / \     l-rotate(N)     / \
+        //   L   R    ==========>    N   RR
+        //      / \                 / \
+        //    RL   RR              L   RL
+        // clang-format on
+
+        assert(node != nullptr && node->right != nullptr);
+        counters.rotation();
+            
+        Node* parent = node->parent;
+        Dir dir = node->dir();
+
+        Node* r = node->right;
+        node->right = r->left;
+        r->left = node;
+        r->parent = parent;
+
+        updateMyChildrensParent(node);
+        updateMyChildrensParent(r);
+        if constexpr (Augment::ENABLED) {
+            Augment::pull(node);
+            Augment::pull(r);
+        }
+
+        switch (dir) {
+            case Node::ROOT: this->root = r; break;
+            case Node::LEFT: parent->left = r; break;
+            case Node::RIGHT: parent->right = r; break;
+        }
+    }
+
+    void rotateRight(Node *node) {
+        // clang-format off
+        //       |                   |
+        //       N                   L
+        //      / \   r-rotate(N)   / \
+        //     L   R  ==========> LL   N
+        //    / \                     / \
+        //  LL   LR                 LR   R
+        // clang-format on
+        assert(node != nullptr && node->left != nullptr);
+        counters.rotation();
+
+        Node *parent = node->parent;
+        Dir dir = node->dir();
+
+        Node *l = node->left;
         node->left = l->right;
         l->right = node;
         l->parent = parent;
 
         updateMyChildrensParent(node);
         updateMyChildrensParent(l);
+        if constexpr (Augment::ENABLED) {
+            Augment::pull(node);
+            Augment::pull(l);
+        }
 
         switch (dir) {
             case Dir::ROOT: this->root = l; break;
@@ -243,64 +1445,67 @@ private:
         }
     }
 
+    // node is RED; walks up while Case 4 pushes the RED grandparent further, reading each parent link once
     void maintainAfterInsert(Node *node) {
         assert(node != nullptr);
+        counters.insertFixup();
 
-        if (node->isRoot()) {
-            // Case 1: Current node is root (RED)
-            // No need to fix.
-            assert(node->isRed());
-            return;
-        }
+        while (true) {
+            Node *parent = node->parent;
+            if (parent == nullptr) {
+                // Case 1: Current node is root (RED)
+                // No need to fix.
+                assert(node->isRed());
+                return;
+            }
 
-        if (node->parent->isBlack()) {
-            // Case 2: Parent is BLACK
-            // No need to fix.
-            return;
-        }
+            if (parent->isBlack()) {
+                // Case 2: Parent is BLACK
+                // No need to fix.
+                return;
+            }
 
-        if (node->parent->isRoot()) {
-            // clang-format off
-            // Case 3: Parent is root and is RED
-            //   Paint parent to BLACK.
-            //    <P>         [P]
-            //     |   ====>   |
-            //    <N>         <N>
-            //   p.s.
-            //    `<X>` is a RED node;
-            //    `[X]` is a BLACK node (or NIL);
-            //    `{X}` is either a RED node or a BLACK node;
-            // clang-format on
-            assert(node->parent->isRed());
-            node->parent->color = Color::BLACK;
-            return;
-        }
+            Node *grand = parent->parent;
+            if (grand == nullptr) {
+                // clang-format off
+                // Case 3: Parent is root and is RED
+                //   Paint parent to BLACK.
+                //    <P>         [P]
+                //     |   ====>   |
+                //    <N>         <N>
+                //   p.s.
+                //    `<X>` is a RED node;
+                //    `[X]` is a BLACK node (or NIL);
+                //    `{X}` is either a RED node or a BLACK node;
+                // clang-format on
+                parent->color = Color::BLACK;
+                return;
+            }
 
-        if (node->hasUncle() && node->uncle()->isRed()) {
-            // clang-format off
-            // Case 4: Both parent and uncle are RED
-            //   Paint parent and uncle to BLACK;
-            //   Paint grandparent to RED.
-            //        [G]             <G>
-            //        / \             / \
-            //      <P> <U>  ====>  [P] [U]
-            //      /               /
-            //    <N>             <N>
-            // clang-format on
-            assert(node->parent->isRed());
-            node->parent->color = Color::BLACK;
-            node->uncle()->color = Color::BLACK;
-            node->grandParent()->color = Color::RED;
-            maintainAfterInsert(node->grandParent());
-            return;
-        }
+            bool parentIsLeft = grand->left == parent;
+            Node *uncle = parentIsLeft ? grand->right : grand->left;
+            if (uncle != nullptr && uncle->isRed()) {
+                // clang-format off
+                // Case 4: Both parent and uncle are RED
+                //   Paint parent and uncle to BLACK;
+                //   Paint grandparent to RED.
+                //        [G]             <G>
+                //        / \             / \
+                //      <P> <U>  ====>  [P] [U]
+                //      /               /
+                //    <N>             <N>
+                // clang-format on
+                parent->color = Color::BLACK;
+                uncle->color = Color::BLACK;
+                grand->color = Color::RED;
+                counters.recolor();
+                node = grand;
+                continue;
+            }
 
-        if (!node->hasUncle() || node->uncle()->isBlack()) {
             // Case 5 & 6: Parent is RED and Uncle is BLACK
             //   p.s. NIL nodes are also considered BLACK
-            assert(!node->isRoot());
-
-            if (node->dir() != node->dir()) {
+            if ((parent->left == node) != parentIsLeft) {
                 // clang-format off
                 // Case 5: Current node is the opposite direction as parent
                 //   Step 1. If node is a LEFT child, perform l-rotate to parent;
@@ -312,17 +1517,9 @@ private:
                 //      \                 /
                 //      <N>             <P>
                 // clang-format on
-
-                // Step 1: Rotation
-                Node* parent = node->parent;
-                if (node->dir() == Dir::LEFT) {
-                    rotateRight(node->parent);
-                } 
-                else /* node->dir() == Dir::RIGHT */ {
-                    rotateLeft(node->parent);
-                }
-                node = parent;
-                // Step 2: vvv
+                if (parentIsLeft) rotateLeft(parent);
+                else rotateRight(parent);
+                parent = node;
             }
 
             // clang-format off
@@ -337,25 +1534,130 @@ private:
             //      /                         \                 \
             //    <N>                         [U]               [U]
             // clang-format on
+            if (parentIsLeft) rotateRight(grand);
+            else rotateLeft(grand);
+            parent->color = Color::BLACK;
+            grand->color = Color::RED;
+            return;
+        }
+    }
 
-            assert(node->grandParent() != nullptr);
+    void maintainAfterRemove(Node *node) {
+        // node is a BLACK non-root node whose path is about to lose one BLACK
+        counters.removeFixup();
+        while (!node->isRoot()) {
+            Dir dir = node->dir();
+            Node *parent = node->parent;
+            Node *sibling = node->sibling();
+            assert(sibling != nullptr);
 
-            // Step 1
-            if (node->parent->dir() == Dir::LEFT) {
-                rotateRight(node->grandParent());
-            } 
-            else {
-                rotateLeft(node->grandParent());
+            if (sibling->isRed()) {
+                // clang-format off
+                // Case 1: Sibling is RED, so parent and nephews are BLACK
+                //   Rotate parent towards node, paint sibling BLACK and parent RED,
+                //   then go on with the new (BLACK) sibling.
+                //      [P]                   [S]
+                //      / \    rotate(P)     /   \
+                //    [N] <S>  ========>   <P>  [D]
+                //        / \              / \
+                //      [C] [D]          [N] [C]
+                // clang-format on
+                if (dir == Dir::LEFT) rotateLeft(parent);
+                else rotateRight(parent);
+                sibling->color = Color::BLACK;
+                parent->color = Color::RED;
+                sibling = node->sibling();
             }
 
-            // Step 2
-            node->parent->color = Color::BLACK;
-            node->sibling()->color = Color::RED;
+            Node *closeNephew = dir == Dir::LEFT ? sibling->left : sibling->right;
+            Node *distantNephew = dir == Dir::LEFT ? sibling->right : sibling->left;
+            bool closeRed = closeNephew != nullptr && closeNephew->isRed();
+            bool distantRed = distantNephew != nullptr && distantNephew->isRed();
 
+            if (!closeRed && !distantRed) {
+                if (parent->isRed()) {
+                    // Case 3: Sibling and nephews are BLACK, parent is RED
+                    //   Swap the colors of parent and sibling, which restores the missing BLACK.
+                    sibling->color = Color::RED;
+                    parent->color = Color::BLACK;
+                    return;
+                }
+                // Case 2: Parent, sibling and nephews are all BLACK
+                //   Paint sibling RED, now the whole parent subtree is one BLACK short: go up.
+                sibling->color = Color::RED;
+                node = parent;
+                continue;
+            }
+
+            if (!distantRed) {
+                // clang-format off
+                // Case 4: Close nephew is RED, distant nephew is BLACK
+                //   Rotate sibling away from node, paint close nephew BLACK and sibling RED,
+                //   the close nephew becomes the new sibling: goto Case 5.
+                //      {P}                 {P}
+                //      / \    rotate(S)    / \
+                //    [N] [S]  ========>  [N] [C]
+                //        / \                   \
+                //      <C> [D]                 <S>
+                // clang-format on
+                if (dir == Dir::LEFT) rotateRight(sibling);
+                else rotateLeft(sibling);
+                closeNephew->color = Color::BLACK;
+                sibling->color = Color::RED;
+                distantNephew = sibling;
+                sibling = closeNephew;
+            }
+
+            // clang-format off
+            // Case 5: Distant nephew is RED
+            //   Rotate parent towards node, sibling takes parent's color,
+            //   parent and distant nephew become BLACK.
+            //      {P}                 {S}
+            //      / \    rotate(P)    / \
+            //    [N] [S]  ========>  [P] [D]
+            //          \             /
+            //          <D>         [N]
+            // clang-format on
+            if (dir == Dir::LEFT) rotateLeft(parent);
+            else rotateRight(parent);
+            sibling->color = parent->color;
+            parent->color = Color::BLACK;
+            distantNephew->color = Color::BLACK;
             return;
         }
     }
 
+    static int nodeHeight(const Node *node) {
+        return node == nullptr ? 0 : 1 + max(nodeHeight(node->left), nodeHeight(node->right));
+    }
+
+    // black height of the subtree (NIL counts 0) with all keys strictly between lo and hi, -1 on a violation
+    int validateSubtree(const Node *node, const K *lo, const K *hi, size_t &n, string *error) const {
+        if (node == nullptr) return 0;
+        ++n;
+        auto fail = [error](const string &why) {
+            if (error != nullptr) *error = why;
+            return -1;
+        };
+        if ((lo != nullptr && !cmp(*lo, node->key())) || (hi != nullptr && !cmp(node->key(), *hi))) {
+            return fail("keys out of order");
+        }
+        for (const Node *child: {node->left, node->right}) {
+            if (child == nullptr) continue;
+            if (child->parent != node) return fail("child with a wrong parent link");
+            if (node->isRed() && child->isRed()) return fail("RED node with a RED child");
+        }
+        if constexpr (Augment::HAS_SIZE) {
+            if (node->aug.size != 1 + subtreeSize(node->left) + subtreeSize(node->right)) return fail("stale subtree size");
+        }
+        int l = validateSubtree(node->left, lo, &node->key(), n, error);
+        if (l < 0) return -1;
+        int r = validateSubtree(node->right, &node->key(), hi, n, error);
+        if (r < 0) return -1;
+        if (l != r) return fail("black heights " + to_string(l) + " and " + to_string(r) + " below one node");
+        return l + node->isBlack();
+    }
+
     static void updateMyChildrensParent(Node *node) {
         if (node->left != nullptr) {
             node->left->parent = node;
@@ -366,10 +1668,1323 @@ private:
     }
 
     Node *root;
-    Compare cmp;
+
+    Node *leftmost = nullptr, *rightmost = nullptr;
+    size_t count = 0;
+    // empty comparators, allocators and NoStats take no space
+    [[no_unique_address]] typename Stats::template Comparator<Compare> cmp;
+    [[no_unique_address]] NodeAlloc alloc;
+    [[no_unique_address]] Stats counters;
 };
 
-int main() {
+/**
+ * B+-tree with the ordered-map interface of RBTree, for read-heavy maps with small keys.
+ * Keys and values live in separate arrays, so a node's search only touches its 256 bytes of keys,
+ * which stay 64-byte aligned. For integral keys with less<K> the unused key slots hold the largest
+ * key, and the search is a branch-free count of smaller keys: AVX2 / SSE2 compares on 32 and 64 bit
+ * keys when the compiler targets them, a plain loop the compiler can vectorize otherwise.
+ * Leaves are chained in key order. erase() never merges nodes, a leaf may run empty and is skipped.
+ * V has to be default constructible.
+*/
+template<class K, class V, class Compare = less<K>>
+class BPlusTree {
+private:
+    struct Leaf;
+    struct Inner;
+
+public:
+    BPlusTree() {}
+    BPlusTree(const BPlusTree&) = delete;
+    BPlusTree& operator= (const BPlusTree&) = delete;
+
+    ~BPlusTree() {
+        clear();
+    }
+
+    template <bool IsConst> struct BasicIterator;
+    using Iterator = BasicIterator<false>;
+    using ConstIterator = BasicIterator<true>;
+
+    size_t size() const noexcept { return this->count; }
+    bool empty() const noexcept { return this->count == 0; }
+
+    // inserts, or overwrites the value if k is already there
+    Iterator insert(const K &k, const V &v) {
+        if (root == nullptr) {
+            root = head = new Leaf();
+            height = 0;
+        }
+
+        Inner *path[MAX_HEIGHT];
+        int slot[MAX_HEIGHT];
+        void *node = root;
+        for (int d = 0; d < height; ++d) {
+            Inner *inner = static_cast<Inner*>(node);
+            path[d] = inner;
+            slot[d] = upperIndex(inner->keys, inner->n, k);
+            node = inner->children[slot[d]];
+        }
+
+        Leaf *leaf = static_cast<Leaf*>(node);
+        int pos = lowerIndex(leaf->keys, leaf->n, k);
+        if (pos < leaf->n && !cmp(k, leaf->keys[pos])) {
+            leaf->values[pos] = v;
+            return Iterator(leaf, pos, this);
+        }
+        ++count;
+        if (leaf->n < LEAF_KEYS) {
+            insertAt(leaf, pos, k, v);
+            return Iterator(leaf, pos, this);
+        }
+
+        // Split a full leaf in half. Appending past the last leaf starts a new one instead,
+        // so ascending inserts fill leaves completely.
+        Leaf *right = new Leaf();
+        int keep = leaf->next == nullptr && pos == LEAF_KEYS ? LEAF_KEYS : LEAF_KEYS / 2;
+        for (int i = keep; i < leaf->n; ++i) {
+            right->keys[i - keep] = leaf->keys[i];
+            right->values[i - keep] = std::move(leaf->values[i]);
+            leaf->keys[i] = PAD;
+        }
+        right->n = leaf->n - keep;
+        leaf->n = keep;
+        right->prev = leaf;
+        right->next = leaf->next;
+        if (leaf->next != nullptr) leaf->next->prev = right;
+        leaf->next = right;
+
+        Iterator result = pos < keep ? Iterator(leaf, pos, this) : Iterator(right, pos - keep, this);
+        insertAt(result.leaf, result.index, k, v);
+        insertSeparator(path, slot, right->keys[0], right);
+        return result;
+    }
+
+    // same interface as RBTree, a descent is only a few cache lines here so the hint is not used
+    Iterator insert(Iterator, const K &k, const V &v) {
+        return insert(k, v);
+    }
+
+    // removes the entry at pos and returns the one after it
+    Iterator erase(Iterator pos) {
+        Leaf *leaf = pos.leaf;
+        assert(leaf != nullptr && pos.index < leaf->n);
+        eraseAt(leaf, pos.index);
+        if (pos.index < leaf->n) return pos;
+        return Iterator(nextLeaf(leaf), 0, this);
+    }
+
+    size_t erase(const K &k) {
+        Iterator it = find(k);
+        if (it == end()) return 0;
+        erase(it);
+        return 1;
+    }
+
+    Iterator find(const K &k) { return Iterator(findPos(k), this); }
+    ConstIterator find(const K &k) const { return ConstIterator(findPos(k), this); }
+    bool contains(const K &k) const { return findPos(k).first != nullptr; }
+
+    // first key >= k
+    Iterator lower_bound(const K &k) { return Iterator(boundPos(k, false), this); }
+    ConstIterator lower_bound(const K &k) const { return ConstIterator(boundPos(k, false), this); }
+
+    // first key > k
+    Iterator upper_bound(const K &k) { return Iterator(boundPos(k, true), this); }
+    ConstIterator upper_bound(const K &k) const { return ConstIterator(boundPos(k, true), this); }
+
+    void clear() {
+        if (root != nullptr) destroy(root, height);
+        root = head = nullptr;
+        height = 0;
+        count = 0;
+    }
+
+    size_t memory_usage() const {
+        size_t leaves = 0, inners = 0;
+        for (Leaf *leaf = head; leaf != nullptr; leaf = leaf->next) ++leaves;
+        if (root != nullptr) inners = countInner(root, height);
+        return sizeof(*this) + leaves * sizeof(Leaf) + inners * sizeof(Inner);
+    }
+
+    template <bool IsConst>
+    struct BasicIterator
+    {
+    public:
+        using LeafPtr = conditional_t<IsConst, const Leaf*, Leaf*>;
+        BasicIterator(): leaf(nullptr), index(0), tree(nullptr) {}
+        BasicIterator(LeafPtr l, int i, const BPlusTree *t): leaf(l), index(i), tree(t) {}
+        BasicIterator(pair<LeafPtr, int> pos, const BPlusTree *t): leaf(pos.first), index(pos.second), tree(t) {}
+        template <bool C, typename = enable_if_t<IsConst && !C>>
+        BasicIterator(const BasicIterator<C> &iter): leaf(iter.leaf), index(iter.index), tree(iter.tree) {}
+        using iterator_category = std::bidirectional_iterator_tag;
+        using difference_type   = std::ptrdiff_t;
+        using value_type        = pair<K, V>;
+        // keys and values are stored apart, so entries come out as a pair of references
+        using reference         = pair<const K&, conditional_t<IsConst, const V&, V&>>;
+        struct pointer {
+            reference ref;
+            const reference* operator-> () const { return &ref; }
+        };
+
+        reference operator* () const { return reference(leaf->keys[index], leaf->values[index]); }
+        pointer operator-> () const { return pointer{operator*()}; }
+        BasicIterator& operator++ () {
+            if (++index == leaf->n) {
+                leaf = nextLeaf(leaf);
+                index = 0;
+            }
+            return *this;
+        }
+        BasicIterator operator++ (int) {
+            BasicIterator tmp = *this;
+            ++*this;
+            return tmp;
+        }
+
+        // end() has no leaf, stepping back from it starts past the last entry of the last leaf
+        BasicIterator& operator-- () {
+            if (leaf == nullptr) {
+                leaf = tree->lastLeaf();
+                index = leaf->n;
+            }
+            while (index == 0) {
+                leaf = leaf->prev;
+                index = leaf->n;
+            }
+            --index;
+            return *this;
+        }
+        BasicIterator operator-- (int) {
+            BasicIterator tmp = *this;
+            --*this;
+            return tmp;
+        }
+
+        friend bool operator== (const BasicIterator &x, const BasicIterator &y) {
+            return x.leaf == y.leaf && x.index == y.index;
+        }
+
+        friend bool operator!= (const BasicIterator &x, const BasicIterator &y) {
+            return !(x == y);
+        }
+
+    private:
+        friend class BPlusTree;
+        template <bool> friend struct BasicIterator;
+        LeafPtr leaf;
+        int index;
+        const BPlusTree *tree;
+    };
+
+    Iterator begin() { return Iterator(head != nullptr && head->n == 0 ? nextLeaf(head) : head, 0, this); }
+    Iterator end() { return Iterator(nullptr, 0, this); }
+    ConstIterator begin() const { return ConstIterator(head != nullptr && head->n == 0 ? nextLeaf(head) : head, 0, this); }
+    ConstIterator end() const { return ConstIterator(nullptr, 0, this); }
+    ConstIterator cbegin() const { return begin(); }
+    ConstIterator cend() const { return end(); }
+
+private:
+    // integral keys are searched over padded, fixed-size key arrays
+    static constexpr bool PADDED = is_integral_v<K> && is_same_v<Compare, less<K>>;
+    static constexpr int NODE_KEYS = max<int>(8, 256 / sizeof(K));
+    static constexpr int LEAF_KEYS = NODE_KEYS, INNER_KEYS = NODE_KEYS;
+    static constexpr int MAX_HEIGHT = 32;
+    static inline const K PAD = [] { if constexpr (PADDED) return numeric_limits<K>::max(); else return K(); }();
+
+    struct Leaf {
+        alignas(64) K keys[LEAF_KEYS];
+        V values[LEAF_KEYS];
+        Leaf *prev = nullptr, *next = nullptr;
+        int n = 0;
+
+        Leaf() { fill(keys, keys + LEAF_KEYS, PAD); }
+    };
+
+    struct Inner {
+        // children[i] holds the keys in [keys[i - 1], keys[i])
+        alignas(64) K keys[INNER_KEYS];
+        void *children[INNER_KEYS + 1];
+        int n = 0;
+
+        Inner() { fill(keys, keys + INNER_KEYS, PAD); }
+    };
+
+    // rightmost leaf, possibly empty; the tree must not be
+    Leaf* lastLeaf() const {
+        void *node = root;
+        for (int d = 0; d < height; ++d) {
+            Inner *inner = static_cast<Inner*>(node);
+            node = inner->children[inner->n];
+        }
+        return static_cast<Leaf*>(node);
+    }
+
+    template <typename L>
+    static L* nextLeaf(L *leaf) {
+        do leaf = leaf->next; while (leaf != nullptr && leaf->n == 0);
+        return leaf;
+    }
+
+    // number of keys[0, n) less than k
+    static int countLess(const K *keys, int n, const K &k) {
+#if defined(__AVX2__)
+        if constexpr (PADDED && sizeof(K) == 4 && is_signed_v<K>) {
+            __m256i x = _mm256_set1_epi32(k);
+            int c = 0;
+            for (int i = 0; i < n; i += 8) {
+                __m256i v = _mm256_load_si256(reinterpret_cast<const __m256i*>(keys + i));
+                c += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(x, v))));
+            }
+            return c;
+        }
+        if constexpr (PADDED && sizeof(K) == 8 && is_signed_v<K>) {
+            __m256i x = _mm256_set1_epi64x(k);
+            int c = 0;
+            for (int i = 0; i < n; i += 4) {
+                __m256i v = _mm256_load_si256(reinterpret_cast<const __m256i*>(keys + i));
+                c += __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(x, v))));
+            }
+            return c;
+        }
+#elif defined(__SSE2__)
+        if constexpr (PADDED && sizeof(K) == 4 && is_signed_v<K>) {
+            __m128i x = _mm_set1_epi32(k);
+            int c = 0;
+            for (int i = 0; i < n; i += 4) {
+                __m128i v = _mm_load_si128(reinterpret_cast<const __m128i*>(keys + i));
+                c += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(x, v))));
+            }
+            return c;
+        }
+#endif
+        if constexpr (PADDED) {
+            // padding never counts, so run to a multiple of 8 and let the compiler vectorize
+            int c = 0, m = (n + 7) & ~7;
+            for (int i = 0; i < m; ++i) c += keys[i] < k;
+            return c;
+        }
+        else {
+            return int(std::lower_bound(keys, keys + n, k, Compare()) - keys);
+        }
+    }
+
+    // first index with key >= k
+    static int lowerIndex(const K *keys, int n, const K &k) {
+        return countLess(keys, n, k);
+    }
+
+    // first index with key > k
+    static int upperIndex(const K *keys, int n, const K &k) {
+        if constexpr (PADDED) {
+            return k == numeric_limits<K>::max() ? n : countLess(keys, n, K(k + 1));
+        }
+        else {
+            return int(std::upper_bound(keys, keys + n, k, Compare()) - keys);
+        }
+    }
+
+    Leaf* findLeaf(const K &k) const {
+        void *node = root;
+        for (int d = 0; d < height; ++d) {
+            const Inner *inner = static_cast<const Inner*>(node);
+            node = inner->children[upperIndex(inner->keys, inner->n, k)];
+        }
+        return static_cast<Leaf*>(node);
+    }
+
+    pair<Leaf*, int> findPos(const K &k) const {
+        if (root == nullptr) return {nullptr, 0};
+        Leaf *leaf = findLeaf(k);
+        int pos = lowerIndex(leaf->keys, leaf->n, k);
+        if (pos < leaf->n && !cmp(k, leaf->keys[pos])) return {leaf, pos};
+        return {nullptr, 0};
+    }
+
+    pair<Leaf*, int> boundPos(const K &k, bool upper) const {
+        if (root == nullptr) return {nullptr, 0};
+        Leaf *leaf = findLeaf(k);
+        int pos = upper ? upperIndex(leaf->keys, leaf->n, k) : lowerIndex(leaf->keys, leaf->n, k);
+        if (pos < leaf->n) return {leaf, pos};
+        return {nextLeaf(leaf), 0};
+    }
+
+    void insertAt(Leaf *leaf, int pos, const K &k, const V &v) {
+        for (int i = leaf->n; i > pos; --i) {
+            leaf->keys[i] = leaf->keys[i - 1];
+            leaf->values[i] = std::move(leaf->values[i - 1]);
+        }
+        leaf->keys[pos] = k;
+        leaf->values[pos] = v;
+        ++leaf->n;
+    }
+
+    void eraseAt(Leaf *leaf, int pos) {
+        for (int i = pos + 1; i < leaf->n; ++i) {
+            leaf->keys[i - 1] = leaf->keys[i];
+            leaf->values[i - 1] = std::move(leaf->values[i]);
+        }
+        --leaf->n;
+        leaf->keys[leaf->n] = PAD;
+        leaf->values[leaf->n] = V();
+        --count;
+    }
+
+    // hang child right of path[d]->children[slot[d]] level by level, splitting full inner nodes on the way up
+    void insertSeparator(Inner **path, int *slot, K sep, void *child) {
+        for (int d = height - 1; d >= 0; --d) {
+            Inner *inner = path[d];
+            int c = slot[d];
+            if (inner->n < INNER_KEYS) {
+                for (int i = inner->n; i > c; --i) {
+                    inner->keys[i] = inner->keys[i - 1];
+                    inner->children[i + 1] = inner->children[i];
+                }
+                inner->keys[c] = sep;
+                inner->children[c + 1] = child;
+                ++inner->n;
+                return;
+            }
+
+            K keys[INNER_KEYS + 1];
+            void *children[INNER_KEYS + 2];
+            for (int i = 0, j = 0; i <= INNER_KEYS; ++i) keys[i] = i == c ? sep : inner->keys[j++];
+            for (int i = 0, j = 0; i <= INNER_KEYS + 1; ++i) children[i] = i == c + 1 ? child : inner->children[j++];
+
+            // the middle key moves up, the keys on either side stay in the two halves
+            int mid = (INNER_KEYS + 1) / 2;
+            Inner *right = new Inner();
+            inner->n = mid;
+            right->n = INNER_KEYS - mid;
+            for (int i = 0; i < INNER_KEYS; ++i) inner->keys[i] = i < mid ? keys[i] : PAD;
+            for (int i = 0; i <= mid; ++i) inner->children[i] = children[i];
+            for (int i = 0; i < right->n; ++i) right->keys[i] = keys[mid + 1 + i];
+            for (int i = 0; i <= right->n; ++i) right->children[i] = children[mid + 1 + i];
+            sep = keys[mid];
+            child = right;
+        }
+
+        Inner *top = new Inner();
+        top->n = 1;
+        top->keys[0] = sep;
+        top->children[0] = root;
+        top->children[1] = child;
+        root = top;
+        ++height;
+    }
+
+    static void destroy(void *node, int depth) {
+        if (depth == 0) {
+            delete static_cast<Leaf*>(node);
+            return;
+        }
+        Inner *inner = static_cast<Inner*>(node);
+        for (int i = 0; i <= inner->n; ++i) destroy(inner->children[i], depth - 1);
+        delete inner;
+    }
+
+    static size_t countInner(void *node, int depth) {
+        if (depth == 0) return 0;
+        Inner *inner = static_cast<Inner*>(node);
+        size_t c = 1;
+        for (int i = 0; i <= inner->n; ++i) c += countInner(inner->children[i], depth - 1);
+        return c;
+    }
+
+    void *root = nullptr;
+    Leaf *head = nullptr;
+    int height = 0;
+    size_t count = 0;
+    Compare cmp;
+};
+
+/**
+ * Red-black tree for one writer and any number of concurrent readers.
+ * The writer path-copies: insert and erase copy the nodes they would change and publish a new root,
+ * so nodes reachable from a published root are never written again. Nodes carry no parent pointer,
+ * which would force copying the whole tree; balancing follows the left-leaning red-black scheme,
+ * whose recursive insert / erase only touch the search path.
+ * snapshot() pins an epoch and takes the current root, a reader then walks an immutable tree.
+ * Replaced nodes are retired with the epoch of the update and freed once no active snapshot
+ * started at or before that epoch. Up to READER_SLOTS snapshots may be open at once.
+*/
+template<class K, class V, class Compare = less<K>>
+class PersistentRBTree {
+private:
+    struct Node;
+
+public:
+    static constexpr int READER_SLOTS = 128;
+
+    PersistentRBTree() {}
+    PersistentRBTree(const PersistentRBTree&) = delete;
+    PersistentRBTree& operator= (const PersistentRBTree&) = delete;
+
+    ~PersistentRBTree() {
+        reclaim(numeric_limits<uint64_t>::max());
+        destroy(root.load());
+    }
+
+    class Snapshot;
+    struct ConstIterator;
+
+    // the writer's view, readers use snapshot().size()
+    size_t size() const noexcept { return sizeOf(root.load(memory_order_relaxed)); }
+    bool empty() const noexcept { return root.load(memory_order_relaxed) == nullptr; }
+
+    // writer only: inserts, or overwrites the value if k is already there
+    void insert(const K &k, const V &v) {
+        Node *top = put(root.load(memory_order_relaxed), k, v);
+        top->color = BLACK;
+        publish(top);
+    }
+
+    // writer only
+    size_t erase(const K &k) {
+        Node *top = root.load(memory_order_relaxed);
+        if (!contains(top, k)) return 0;
+        top = mut(top);
+        if (!isRed(top->left) && !isRed(top->right)) top->color = RED;
+        top = remove(top, k);
+        if (top != nullptr) top->color = BLACK;
+        publish(top);
+        return 1;
+    }
+
+    // any thread: pins the current version until the snapshot is destroyed
+    Snapshot snapshot() const {
+        return Snapshot(this);
+    }
+
+    // nodes retired by the writer and not yet freed
+    size_t retired() const noexcept { return retire_list.size(); }
+
+    struct ConstIterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using difference_type   = std::ptrdiff_t;
+        using value_type        = pair<K, V>;
+        using pointer           = const value_type*;
+        using reference         = const value_type&;
+
+        reference operator* () const { return path.back()->kv; }
+        pointer operator-> () const { return &(operator*()); }
+        ConstIterator& operator++ () {
+            const Node *node = path.back()->right;
+            path.pop_back();
+            for (; node != nullptr; node = node->left) path.push_back(node);
+            return *this;
+        }
+        ConstIterator operator++ (int) {
+            ConstIterator tmp = *this;
+            ++*this;
+            return tmp;
+        }
+
+        friend bool operator== (const ConstIterator &x, const ConstIterator &y) {
+            return x.path.empty() ? y.path.empty() : !y.path.empty() && x.path.back() == y.path.back();
+        }
+
+        friend bool operator!= (const ConstIterator &x, const ConstIterator &y) {
+            return !(x == y);
+        }
+
+    private:
+        friend class PersistentRBTree;
+        // ancestors still to visit, the current node on top; without parent pointers this is the way back up
+        vector<const Node*> path;
+    };
+
+    // an immutable version of the tree, valid for as long as this object lives
+    class Snapshot {
+    public:
+        Snapshot(Snapshot &&other) noexcept: tree(other.tree), slot(other.slot), top(other.top) {
+            other.tree = nullptr;
+        }
+        Snapshot& operator= (Snapshot&&) = delete;
+
+        ~Snapshot() {
+            if (tree != nullptr) tree->slots[slot].epoch.store(0, memory_order_release);
+        }
+
+        size_t size() const noexcept { return sizeOf(top); }
+        bool empty() const noexcept { return top == nullptr; }
+        bool contains(const K &k) const { return tree->contains(top, k); }
+
+        ConstIterator find(const K &k) const {
+            ConstIterator it = lower_bound(k);
+            if (it != end() && tree->cmp(k, it->first)) return end();
+            return it;
+        }
+
+        // first key >= k
+        ConstIterator lower_bound(const K &k) const {
+            ConstIterator it;
+            for (const Node *node = top; node != nullptr; ) {
+                if (tree->cmp(node->key(), k)) {
+                    node = node->right;
+                }
+                else {
+                    it.path.push_back(node);
+                    node = node->left;
+                }
+            }
+            return it;
+        }
+
+        ConstIterator begin() const {
+            ConstIterator it;
+            for (const Node *node = top; node != nullptr; node = node->left) it.path.push_back(node);
+            return it;
+        }
+
+        ConstIterator end() const { return ConstIterator(); }
+
+    private:
+        friend class PersistentRBTree;
+
+        explicit Snapshot(const PersistentRBTree *t): tree(t) {
+            static thread_local size_t hint = hash<thread::id>()(this_thread::get_id());
+            for (slot = hint % READER_SLOTS; ; slot = (slot + 1) % READER_SLOTS) {
+                uint64_t free = 0;
+                // a stale epoch only keeps more nodes alive, the root is read after the slot is set
+                if (tree->slots[slot].epoch.compare_exchange_strong(free, tree->epoch.load())) break;
+            }
+            hint = slot;
+            top = tree->root.load();
+        }
+
+        const PersistentRBTree *tree;
+        int slot;
+        const Node *top;
+    };
+
+private:
+    enum Color { RED, BLACK };
+
+    struct Node {
+        pair<K, V> kv;
+        Node *left = nullptr, *right = nullptr;
+        size_t size = 1;
+        // epoch of the update that created the node, nodes of the running update are still private
+        uint64_t stamp;
+        Color color = RED;
+
+        Node(const K &k, const V &v, uint64_t s): kv(k, v), stamp(s) {}
+        inline const K& key() const noexcept { return this->kv.first; }
+    };
+
+    struct alignas(64) ReaderSlot {
+        atomic<uint64_t> epoch{0};
+    };
+
+    static size_t sizeOf(const Node *node) { return node != nullptr ? node->size : 0; }
+    static bool isRed(const Node *node) { return node != nullptr && node->color == RED; }
+
+    bool contains(const Node *node, const K &k) const {
+        while (node != nullptr) {
+            if (cmp(k, node->key())) node = node->left;
+            else if (cmp(node->key(), k)) node = node->right;
+            else return true;
+        }
+        return false;
+    }
+
+    // a node the running update may write to: itself if it was created by this update, a copy otherwise
+    Node* mut(Node *node) {
+        if (node->stamp == current) return node;
+        Node *copy = new Node(*node);
+        copy->stamp = current;
+        retire(node);
+        return copy;
+    }
+
+    void retire(Node *node) {
+        if (node->stamp == current) delete node;
+        else retire_list.emplace_back(current, node);
+    }
+
+    void pull(Node *node) {
+        node->size = 1 + sizeOf(node->left) + sizeOf(node->right);
+    }
+
+    Node* rotateLeft(Node *node) {
+        Node *r = mut(node->right);
+        node->right = r->left;
+        r->left = node;
+        r->color = node->color;
+        node->color = RED;
+        pull(node);
+        pull(r);
+        return r;
+    }
+
+    Node* rotateRight(Node *node) {
+        Node *l = mut(node->left);
+        node->left = l->right;
+        l->right = node;
+        l->color = node->color;
+        node->color = RED;
+        pull(node);
+        pull(l);
+        return l;
+    }
+
+    void flipColors(Node *node) {
+        node->left = mut(node->left);
+        node->right = mut(node->right);
+        node->color = node->color == RED ? BLACK : RED;
+        node->left->color = node->left->color == RED ? BLACK : RED;
+        node->right->color = node->right->color == RED ? BLACK : RED;
+    }
+
+    Node* balance(Node *node) {
+        if (isRed(node->right) && !isRed(node->left)) node = rotateLeft(node);
+        if (isRed(node->left) && isRed(node->left->left)) node = rotateRight(node);
+        if (isRed(node->left) && isRed(node->right)) flipColors(node);
+        pull(node);
+        return node;
+    }
+
+    Node* put(Node *node, const K &k, const V &v) {
+        if (node == nullptr) return new Node(k, v, current);
+        node = mut(node);
+        if (cmp(k, node->key())) node->left = put(node->left, k, v);
+        else if (cmp(node->key(), k)) node->right = put(node->right, k, v);
+        else node->kv.second = v;
+        return balance(node);
+    }
+
+    // node is writable and has a RED left child or left grandchild afterwards
+    Node* moveRedLeft(Node *node) {
+        flipColors(node);
+        if (isRed(node->right->left)) {
+            node->right = rotateRight(node->right);
+            node = rotateLeft(node);
+            flipColors(node);
+        }
+        return node;
+    }
+
+    Node* moveRedRight(Node *node) {
+        flipColors(node);
+        if (isRed(node->left->left)) {
+            node = rotateRight(node);
+            flipColors(node);
+        }
+        return node;
+    }
+
+    // node is writable, returns the subtree without its minimum, which is handed out in min
+    Node* removeMin(Node *node, Node *&min) {
+        if (node->left == nullptr) {
+            min = node;
+            return nullptr;
+        }
+        if (!isRed(node->left) && !isRed(node->left->left)) node = moveRedLeft(node);
+        node->left = removeMin(mut(node->left), min);
+        return balance(node);
+    }
+
+    // node is writable and k is in its subtree
+    Node* remove(Node *node, const K &k) {
+        if (cmp(k, node->key())) {
+            if (!isRed(node->left) && !isRed(node->left->left)) node = moveRedLeft(node);
+            node->left = remove(mut(node->left), k);
+        }
+        else {
+            if (isRed(node->left)) node = rotateRight(node);
+            if (!cmp(node->key(), k) && node->right == nullptr) {
+                retire(node);
+                return nullptr;
+            }
+            if (!isRed(node->right) && !isRed(node->right->left)) node = moveRedRight(node);
+            if (!cmp(node->key(), k)) {
+                Node *min;
+                node->right = removeMin(mut(node->right), min);
+                // min may still be visible to readers, copy out of it
+                node->kv = min->kv;
+                retire(min);
+            }
+            else {
+                node->right = remove(mut(node->right), k);
+            }
+        }
+        return balance(node);
+    }
+
+    /**
+     * Make top the current version. Snapshots that pinned an epoch up to the one of this update may still
+     * reach the nodes it retired; any snapshot taken later reads the new root, so those are freed once
+     * every active slot is past it.
+    */
+    void publish(Node *top) {
+        root.store(top);
+        current = epoch.fetch_add(1) + 1;
+        if (retire_list.size() >= RECLAIM_BATCH) {
+            uint64_t oldest = numeric_limits<uint64_t>::max();
+            for (const ReaderSlot &s: slots) {
+                uint64_t e = s.epoch.load();
+                if (e != 0) oldest = min(oldest, e);
+            }
+            reclaim(oldest);
+        }
+    }
+
+    // free retired nodes of updates before epoch `before`
+    void reclaim(uint64_t before) {
+        size_t i = 0;
+        while (i < retire_list.size() && retire_list[i].first < before) delete retire_list[i++].second;
+        retire_list.erase(retire_list.begin(), retire_list.begin() + i);
+    }
+
+    static void destroy(Node *node) {
+        if (node == nullptr) return;
+        destroy(node->left);
+        destroy(node->right);
+        delete node;
+    }
+
+    static constexpr size_t RECLAIM_BATCH = 1024;
+
+    atomic<Node*> root{nullptr};
+    atomic<uint64_t> epoch{1};
+    mutable ReaderSlot slots[READER_SLOTS];
+    // epoch of the running update, written by the writer only
+    uint64_t current = 1;
+    vector<pair<uint64_t, Node*>> retire_list;
+    Compare cmp;
+};
+
+namespace bench {
+
+using Clock = chrono::steady_clock;
+
+inline double elapsed_ms(Clock::time_point from) {
+    return chrono::duration<double, milli>(Clock::now() - from).count();
+}
+
+// assert() that -DNDEBUG does not compile out, so the checks below keep running the operations they test
+#define RB_TREE_CHECK(cond) ((cond) ? void(0) : bench::check_failed(#cond, __LINE__))
+
+[[noreturn]] inline void check_failed(const char *what, int line) {
+    cerr <<"check failed at line " <<line <<": " <<what <<endl;
+    abort();
+}
+
+template <typename Tree>
+void insert_and_clear(const string &name, const vector<long long> &keys) {
+    auto t0 = Clock::now();
+    {
+        Tree tree;
+        for (long long k: keys) tree.insert(k, k);
+        double insert_ms = elapsed_ms(t0);
+        t0 = Clock::now();
+        tree.clear();
+        cout <<name <<" n=" <<keys.size() <<" insert=" <<insert_ms * 1e6 / keys.size() <<"ns/key"
+             <<" clear=" <<elapsed_ms(t0) <<"ms" <<endl;
+    }
+}
+
+inline void run_allocators(long long n) {
+    mt19937_64 rng(20240601);
+    vector<long long> keys(n);
+    for (long long &k: keys) k = rng();
+    insert_and_clear<RBTree<long long, long long, less<long long>, allocator<pair<long long, long long>>>>("new/delete", keys);
+    insert_and_clear<RBTree<long long, long long>>("node pool ", keys);
+}
+
+// random insert / hinted insert / erase / find / bounds against std::map, aborts on the first difference
+template <typename Tree>
+void run_differential(const string &name, int rounds, int ops) {
+    mt19937 rng(20240601);
+    for (int round = 0; round < rounds; ++round) {
+        Tree tree;
+        map<int, int> expected;
+        int range = 1 + rng() % 2000;
+        for (int op = 0; op < ops; ++op) {
+            int k = rng() % range, v = rng();
+            switch (rng() % 7) {
+                case 0:
+                case 1:
+                    tree.insert(k, v);
+                    expected[k] = v;
+                    break;
+                case 2: {
+                    auto hint = tree.lower_bound(rng() % range);
+                    auto it = tree.insert(hint, k, v);
+                    expected[k] = v;
+                    RB_TREE_CHECK(it->first == k && it->second == v);
+                    break;
+                }
+                case 3: {
+                    size_t erased = tree.erase(k);
+                    RB_TREE_CHECK(erased == expected.erase(k));
+                    break;
+                }
+                case 4: {
+                    auto it = tree.lower_bound(k);
+                    auto ex = expected.lower_bound(k);
+                    if (it != tree.end()) {
+                        RB_TREE_CHECK(ex != expected.end() && it->first == ex->first);
+                        auto next = tree.erase(it);
+                        ex = expected.erase(ex);
+                        RB_TREE_CHECK(next == tree.end() ? ex == expected.end() : next->first == ex->first);
+                    }
+                    else {
+                        RB_TREE_CHECK(ex == expected.end());
+                    }
+                    break;
+                }
+                case 5: {
+                    auto it = tree.upper_bound(k);
+                    auto ex = expected.upper_bound(k);
+                    RB_TREE_CHECK(it == tree.end() ? ex == expected.end() : it->first == ex->first);
+                    break;
+                }
+                case 6: {
+                    const Tree &view = tree;
+                    auto it = view.find(k);
+                    auto ex = expected.find(k);
+                    RB_TREE_CHECK(it == view.end() ? ex == expected.end() : it->second == ex->second);
+                    break;
+                }
+            }
+            RB_TREE_CHECK(tree.size() == expected.size());
+        }
+        RB_TREE_CHECK(equal(tree.begin(), tree.end(), expected.begin(), expected.end(),
+            [](const pair<int, int> &a, const pair<const int, int> &b) { return a.first == b.first && a.second == b.second; }));
+        // and backwards, starting from --end()
+        auto it = tree.end();
+        for (auto ex = expected.rbegin(); ex != expected.rend(); ++ex) {
+            --it;
+            RB_TREE_CHECK(it->first == ex->first);
+        }
+        RB_TREE_CHECK(it == tree.begin());
+    }
+    cout <<name <<" differential check passed: " <<rounds <<" rounds x " <<ops <<" ops" <<endl;
+}
+
+// ops/sec of insert, find, erase on random keys and of ascending inserts with and without a hint
+inline void run_throughput(int n) {
+    mt19937_64 rng(20240601);
+    vector<long long> keys(n);
+    for (long long &k: keys) k = rng();
+    auto mops = [n](double ms) { return n / ms / 1000; };
+
+    RBTree<long long, long long> tree;
+    map<long long, long long> ref;
+    auto t0 = Clock::now();
+    for (long long k: keys) tree.insert(k, k);
+    double tree_insert = elapsed_ms(t0);
+    t0 = Clock::now();
+    for (long long k: keys) ref.emplace(k, k);
+    double map_insert = elapsed_ms(t0);
+
+    shuffle(keys.begin(), keys.end(), rng);
+    long long hits = 0;
+    t0 = Clock::now();
+    for (long long k: keys) hits += tree.find(k) != tree.end();
+    double tree_find = elapsed_ms(t0);
+    t0 = Clock::now();
+    for (long long k: keys) hits += ref.find(k) != ref.end();
+    double map_find = elapsed_ms(t0);
+
+    t0 = Clock::now();
+    for (long long k: keys) tree.erase(k);
+    double tree_erase = elapsed_ms(t0);
+    t0 = Clock::now();
+    for (long long k: keys) ref.erase(k);
+    double map_erase = elapsed_ms(t0);
+
+    RBTree<long long, long long> plain, hinted;
+    t0 = Clock::now();
+    for (long long k = 0; k < n; ++k) plain.insert(k, k);
+    double sorted_plain = elapsed_ms(t0);
+    t0 = Clock::now();
+    for (long long k = 0; k < n; ++k) hinted.insert(hinted.end(), k, k);
+    double sorted_hinted = elapsed_ms(t0);
+
+    cout <<"n=" <<n <<" (Mops/s)" <<(hits == 2ll * n ? "" : " MISMATCH") <<endl
+         <<"  insert  rb=" <<mops(tree_insert) <<" map=" <<mops(map_insert) <<endl
+         <<"  find    rb=" <<mops(tree_find) <<" map=" <<mops(map_find) <<endl
+         <<"  erase   rb=" <<mops(tree_erase) <<" map=" <<mops(map_erase) <<endl
+         <<"  sorted  rb=" <<mops(sorted_plain) <<" rb+hint=" <<mops(sorted_hinted) <<endl;
+}
+
+struct ConcatMonoid {
+    using type = string;
+    static string identity() { return string(); }
+    static string combine(const string &a, const string &b) { return a + b; }
+    static string from(const string &v) { return v; }
+};
+
+// select / rank / range sum on an augmented tree against walking Node::next() from begin()
+inline void run_order_stats(int n, int queries) {
+    using Tree = RBTree<long long, long long, less<long long>, NodePool<pair<long long, long long>>,
+        MonoidAugment<SumMonoid<long long>>>;
+    mt19937_64 rng(20240601);
+    Tree tree;
+    for (int i = 0; i < n; ++i) {
+        long long k = rng() % (4ll * n);
+        tree.insert(k, k % 1000);
+    }
+    for (int i = 0; i < n / 4; ++i) tree.erase((long long)(rng() % (4ll * n)));
+    const Tree &view = tree;
+    size_t size = tree.size();
+
+    vector<size_t> idx(queries);
+    vector<long long> lo(queries), hi(queries);
+    for (int q = 0; q < queries; ++q) {
+        idx[q] = rng() % size;
+        lo[q] = rng() % (4ll * n);
+        hi[q] = lo[q] + rng() % (4ll * n - lo[q] + 1);
+    }
+
+    long long tree_sum = 0, scan_sum = 0;
+    auto t0 = Clock::now();
+    for (int q = 0; q < queries; ++q) tree_sum += view.select(idx[q])->first;
+    double select_log = elapsed_ms(t0);
+    t0 = Clock::now();
+    for (int q = 0; q < queries; ++q) {
+        auto it = view.begin();
+        for (size_t i = 0; i < idx[q]; ++i) ++it;
+        scan_sum += it->first;
+    }
+    double select_scan = elapsed_ms(t0);
+
+    t0 = Clock::now();
+    for (int q = 0; q < queries; ++q) tree_sum += view.rank(lo[q]);
+    double rank_log = elapsed_ms(t0);
+    t0 = Clock::now();
+    for (int q = 0; q < queries; ++q) {
+        size_t r = 0;
+        for (auto it = view.begin(); it != view.end() && it->first < lo[q]; ++it) ++r;
+        scan_sum += r;
+    }
+    double rank_scan = elapsed_ms(t0);
+
+    t0 = Clock::now();
+    for (int q = 0; q < queries; ++q) tree_sum += view.aggregate(lo[q], hi[q]);
+    double sum_log = elapsed_ms(t0);
+    t0 = Clock::now();
+    for (int q = 0; q < queries; ++q) {
+        for (auto it = view.lower_bound(lo[q]); it != view.end() && it->first < hi[q]; ++it) scan_sum += it->second;
+    }
+    double sum_scan = elapsed_ms(t0);
+
+    auto us = [queries](double ms) { return ms * 1000 / queries; };
+    cout <<"n=" <<size <<" queries=" <<queries <<" (us/query)" <<(tree_sum == scan_sum ? "" : " MISMATCH") <<endl
+         <<"  select     log=" <<us(select_log) <<" scan=" <<us(select_scan) <<endl
+         <<"  rank       log=" <<us(rank_log) <<" scan=" <<us(rank_scan) <<endl
+         <<"  range sum  log=" <<us(sum_log) <<" scan=" <<us(sum_scan) <<endl;
+
+    // a monoid whose type owns memory: clear() has to destroy every node instead of dropping the pool
+    using ConcatTree = RBTree<long long, string, less<long long>, NodePool<pair<long long, string>>,
+        MonoidAugment<ConcatMonoid>>;
+    ConcatTree words;
+    for (int i = 0; i < 64; ++i) words.insert(i, string(1 + i % 5, char('a' + i % 26)));
+    string expect;
+    for (auto it = words.lower_bound(10); it != words.end() && it->first < 50; ++it) expect += it->second;
+    bool concat_ok = words.aggregate(10, 50) == expect;
+    words.clear();
+    cout <<"  concat     " <<(concat_ok && words.empty() ? "ok" : "MISMATCH") <<endl;
+}
+
+// sorted bulk load against one insert per key, split / join of a large tree, and merging a batch
+// into a live tree with unite() against inserting the batch one key at a time
+inline void run_bulk(int n, int batch) {
+    using Tree = RBTree<long long, long long>;
+    vector<pair<long long, long long>> sorted(n), extra(batch);
+    for (int i = 0; i < n; ++i) sorted[i] = {2ll * i, i};
+    mt19937_64 rng(20240601);
+    for (auto &e: extra) e = {(long long)(rng() % (2ull * n)), 0};
+    sort(extra.begin(), extra.end());
+
+    auto t0 = Clock::now();
+    Tree bulk;
+    bulk.assign_sorted(sorted.begin(), sorted.end());
+    double bulk_ms = elapsed_ms(t0);
+    t0 = Clock::now();
+    Tree one_by_one;
+    for (auto &e: sorted) one_by_one.insert(e.first, e.second);
+    double insert_ms = elapsed_ms(t0);
+
+    t0 = Clock::now();
+    const int rounds = 1000;
+    for (int i = 0; i < rounds; ++i) {
+        Tree upper;
+        bulk.split(2ll * (rng() % n), upper);
+        bulk.join(upper);
+    }
+    double split_join_us = elapsed_ms(t0) * 1000 / rounds;
+
+    t0 = Clock::now();
+    Tree incoming;
+    incoming.assign_sorted(extra.begin(), extra.end());
+    bulk.unite(incoming);
+    double unite_ms = elapsed_ms(t0);
+    t0 = Clock::now();
+    for (auto &e: extra) one_by_one.insert(e.first, e.second);
+    double batch_insert_ms = elapsed_ms(t0);
+
+    cout <<"n=" <<n <<" batch=" <<batch <<(bulk.size() == one_by_one.size() ? "" : " MISMATCH") <<endl
+         <<"  build       assign_sorted=" <<bulk_ms <<"ms insert=" <<insert_ms <<"ms" <<endl
+         <<"  split+join  " <<split_join_us <<"us" <<endl
+         <<"  merge batch unite=" <<unite_ms <<"ms insert=" <<batch_insert_ms <<"ms" <<endl;
+}
+
+// random inserts, random lookups and a full in-order walk over int keys
+template <typename Tree>
+void lookup_insert_iterate(const string &name, const vector<int> &keys, const vector<int> &probes) {
+    auto mops = [](size_t n, double ms) { return n / ms / 1000; };
+    Tree tree;
+    auto t0 = Clock::now();
+    for (int k: keys) {
+        if constexpr (is_same_v<Tree, map<int, int>>) tree.insert_or_assign(k, k);
+        else tree.insert(k, k);
+    }
+    double insert_ms = elapsed_ms(t0);
+
+    long long hits = 0;
+    t0 = Clock::now();
+    for (int k: probes) hits += tree.find(k) != tree.end();
+    double find_ms = elapsed_ms(t0);
+
+    long long sum = 0;
+    t0 = Clock::now();
+    for (auto it = tree.begin(); it != tree.end(); ++it) sum += it->second;
+    double iterate_ms = elapsed_ms(t0);
+
+    cout <<"  " <<name <<" insert=" <<mops(keys.size(), insert_ms) <<" find=" <<mops(probes.size(), find_ms)
+         <<" iterate=" <<mops(tree.size(), iterate_ms) <<" (hits=" <<hits <<" sum=" <<sum <<")" <<endl;
+}
+
+inline void run_btree(int n) {
+    mt19937 rng(20240601);
+    vector<int> keys(n), probes(n);
+    for (int &k: keys) k = rng() % (4 * n);
+    for (int &k: probes) k = rng() % (4 * n);
+    cout <<"n=" <<n <<" int keys (Mops/s)" <<endl;
+    lookup_insert_iterate<BPlusTree<int, int>>("b+tree  ", keys, probes);
+    lookup_insert_iterate<RBTree<int, int>>("rb_tree ", keys, probes);
+    lookup_insert_iterate<map<int, int>>("std::map", keys, probes);
+}
+
+/**
+ * Reader lookups per second with one writer updating all the time: snapshots of a PersistentRBTree
+ * against an RBTree behind a mutex. Each reader round takes a snapshot (or the lock) and does 16 finds.
+*/
+inline void run_concurrent(int n, int max_readers, int ms) {
+    mt19937 rng(20240601);
+    vector<int> keys(n);
+    for (int &k: keys) k = rng() % (4 * n);
+
+    PersistentRBTree<int, int> persistent;
+    RBTree<int, int> locked;
+    mutex lock;
+    for (int k: keys) {
+        persistent.insert(k, k);
+        locked.insert(k, k);
+    }
+
+    auto measure = [&](int readers, bool use_snapshots) {
+        atomic<bool> stop{false};
+        atomic<long long> lookups{0}, writes{0}, found{0};
+        vector<thread> threads;
+        for (int t = 0; t < readers; ++t) {
+            threads.emplace_back([&, t] {
+                mt19937 local(t);
+                long long done = 0, hits = 0;
+                while (!stop.load(memory_order_relaxed)) {
+                    if (use_snapshots) {
+                        auto snap = persistent.snapshot();
+                        for (int i = 0; i < 16; ++i) hits += snap.contains(local() % (4 * n));
+                    }
+                    else {
+                        lock_guard<mutex> guard(lock);
+                        for (int i = 0; i < 16; ++i) hits += locked.contains(local() % (4 * n));
+                    }
+                    done += 16;
+                }
+                lookups += done;
+                found += hits;
+            });
+        }
+        threads.emplace_back([&] {
+            mt19937 local(20240601);
+            long long done = 0;
+            while (!stop.load(memory_order_relaxed)) {
+                int k = local() % (4 * n);
+                if (use_snapshots) {
+                    if (local() % 2) persistent.insert(k, k);
+                    else persistent.erase(k);
+                }
+                else {
+                    lock_guard<mutex> guard(lock);
+                    if (local() % 2) locked.insert(k, k);
+                    else locked.erase(k);
+                }
+                ++done;
+            }
+            writes += done;
+        });
+        this_thread::sleep_for(chrono::milliseconds(ms));
+        stop = true;
+        for (thread &t: threads) t.join();
+        return make_pair(lookups.load() / (ms * 1000.0), writes.load() / (ms * 1000.0));
+    };
+
+    cout <<"n=" <<n <<" one writer, reader lookups in Mops/s (writer Mops/s)" <<endl;
+    for (int readers = 1; readers <= max_readers; readers *= 2) {
+        auto snap = measure(readers, true);
+        auto mtx = measure(readers, false);
+        cout <<"  readers=" <<readers <<" snapshot=" <<snap.first <<" (" <<snap.second <<")"
+             <<" mutex=" <<mtx.first <<" (" <<mtx.second <<")" <<endl;
+    }
+    cout <<"  retired nodes pending: " <<persistent.retired() <<endl;
+}
+
+// ns per insert of random and ascending keys, with trivially copyable and with string payloads
+inline void run_insert(int n) {
+    mt19937_64 rng(20240601);
+    vector<long long> keys(n);
+    for (long long &k: keys) k = rng();
+    vector<string> payload(n);
+    for (int i = 0; i < n; ++i) payload[i] = string(48, char('a' + i % 26));
+    auto ns = [n](double ms) { return ms * 1e6 / n; };
+
+    auto t0 = Clock::now();
+    {
+        RBTree<long long, long long> tree;
+        for (long long k: keys) tree.insert(k, k);
+    }
+    double random_ms = elapsed_ms(t0);
+    t0 = Clock::now();
+    {
+        RBTree<long long, long long> tree;
+        for (long long k = 0; k < n; ++k) tree.insert(k, k);
+    }
+    double ascending_ms = elapsed_ms(t0);
+    t0 = Clock::now();
+    {
+        RBTree<long long, string> tree;
+        for (int i = 0; i < n; ++i) tree.insert(keys[i], std::move(payload[i]));
+    }
+    double string_ms = elapsed_ms(t0);
+
+    cout <<"n=" <<n <<" (ns/insert, including teardown)" <<endl
+         <<"  random    " <<ns(random_ms) <<endl
+         <<"  ascending " <<ns(ascending_ms) <<endl
+         <<"  string    " <<ns(string_ms) <<endl;
+}
+
+// save a tree, then warm-start from the file: rebuild it with load() or serve it mapped
+inline void run_persistence(int n, const string &path) {
+    mt19937_64 rng(20240601);
+    RBTree<long long, long long> tree;
+    vector<pair<long long, long long>> entries(n);
+    for (int i = 0; i < n; ++i) entries[i] = {3ll * i, (long long)rng()};
+    tree.assign_sorted(entries.begin(), entries.end());
+
+    auto t0 = Clock::now();
+    tree.save(path);
+    double save_ms = elapsed_ms(t0);
+
+    t0 = Clock::now();
+    RBTree<long long, long long> loaded;
+    loaded.load(path);
+    double load_ms = elapsed_ms(t0);
+
+    t0 = Clock::now();
+    MappedRBTree<long long, long long> mapped(path);
+    double map_ms = elapsed_ms(t0);
+
+    bool same = loaded.size() == tree.size() && mapped.size() == tree.size();
+    t0 = Clock::now();
+    for (int q = 0; q < 1000000; ++q) {
+        long long k = rng() % (3ll * n);
+        auto a = tree.find(k);
+        auto b = mapped.find(k);
+        same = same && (a == tree.end() ? b == mapped.end() : b != mapped.end() && b->second == a->second);
+    }
+    double query_ms = elapsed_ms(t0);
+    same = same && equal(loaded.begin(), loaded.end(), mapped.begin(), mapped.end(),
+        [](const pair<long long, long long> &a, const pair<const long long&, const long long&> &b) { return a.first == b.first && a.second == b.second; });
+
+    cout <<"n=" <<n <<" save=" <<save_ms <<"ms load=" <<load_ms <<"ms map=" <<map_ms <<"ms"
+         <<" 1M lookups (tree+mapped)=" <<query_ms <<"ms" <<(same ? "" : " MISMATCH") <<endl;
+}
+
+// counters and shape as JSON for random, ascending and zig-zag insert orders, then half of each erased
+inline void run_stats(int n) {
+    using Tree = RBTree<long long, long long, less<long long>, NodePool<pair<long long, long long>>, NoAugment, RBTreeStats>;
+    mt19937_64 rng(20240601);
+    vector<long long> random(n), ascending(n), zigzag(n);
+    for (int i = 0; i < n; ++i) {
+        random[i] = rng();
+        ascending[i] = i;
+        // converging from both ends, each key hangs on the inner side of the last two: the Case 5 pattern
+        zigzag[i] = i % 2 == 0 ? i / 2 : n - i / 2;
+    }
+    for (auto &[name, keys]: vector<pair<string, vector<long long>*>>{{"random", &random}, {"ascending", &ascending}, {"zigzag", &zigzag}}) {
+        Tree tree;
+        for (long long k: *keys) tree.insert(k, k);
+        string error;
+        bool valid = tree.validate(&error);
+        cout <<name <<" insert " <<tree.stats_json() <<(valid ? "" : " INVALID: " + error) <<endl;
+        for (int i = 0; i < n; i += 2) tree.erase((*keys)[i]);
+        valid = tree.validate(&error);
+        cout <<name <<" erase  " <<tree.stats_json() <<(valid ? "" : " INVALID: " + error) <<endl;
+    }
+}
+
+}  // namespace bench
+
+int main(int argc, char **argv) {
+    if (argc > 1 && string(argv[1]) == "bench") {
+        bench::run_allocators(argc > 2 ? atoll(argv[2]) : 1000000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "map") {
+        bench::run_throughput(argc > 2 ? atoi(argv[2]) : 1000000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "order") {
+        bench::run_order_stats(argc > 2 ? atoi(argv[2]) : 100000, argc > 3 ? atoi(argv[3]) : 2000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "bulk") {
+        bench::run_bulk(argc > 2 ? atoi(argv[2]) : 1000000, argc > 3 ? atoi(argv[3]) : 100000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "btree") {
+        bench::run_btree(argc > 2 ? atoi(argv[2]) : 1000000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "concurrent") {
+        int cores = max(1u, thread::hardware_concurrency());
+        bench::run_concurrent(argc > 2 ? atoi(argv[2]) : 1000000, argc > 3 ? atoi(argv[3]) : cores, 500);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "insert") {
+        bench::run_insert(argc > 2 ? atoi(argv[2]) : 1000000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "persist") {
+        bench::run_persistence(argc > 2 ? atoi(argv[2]) : 10000000, argc > 3 ? argv[3] : "/tmp/rb_tree.bin");
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "stats") {
+        bench::run_stats(argc > 2 ? atoi(argv[2]) : 1000000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "check") {
+        int rounds = argc > 2 ? atoi(argv[2]) : 200, ops = argc > 3 ? atoi(argv[3]) : 5000;
+        bench::run_differential<RBTree<int, int>>("RBTree", rounds, ops);
+        bench::run_differential<BPlusTree<int, int>>("BPlusTree", rounds, ops);
+        return 0;
+    }
+
     RBTree<int, string> tree1;
     tree1.insert(1, "one");
     tree1.insert(2, "two");
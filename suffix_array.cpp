@@ -6,9 +6,238 @@
 #include <functional>
 #include <cmath>
 #include <unordered_set>
+#include <limits>
+#include <type_traits>
+#include <chrono>
+#include <random>
+#include <cstring>
+#include <numeric>
+#include <thread>
+#include <cstdint>
+#include <cstdio>
+#include <queue>
+#include <memory>
+#include <atomic>
+#include <fstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 using namespace std;
 
+/**
+ * On-disk layout, native endianness:
+ *   header | elem | rk | sa | sa_lcp | lcp_in_block | lcp_block_min[0..levels)
+ * offsets[] holds the start of each section in that order.
+*/
+struct SuffixArrayFileHeader {
+    static const uint32_t VERSION = 1;
+    static const int ALIGN = 64;
+    static const int MAX_LEVELS = 32;
+    static const int SECTIONS = 5 + MAX_LEVELS;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t elem_bytes;
+    int64_t size;
+    int64_t levels;
+    uint64_t offsets[SECTIONS];
+
+    static SuffixArrayFileHeader make(uint32_t elem_bytes, int64_t size, int64_t levels) {
+        SuffixArrayFileHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "SUFFIXAR", 8);
+        header.version = VERSION;
+        header.elem_bytes = elem_bytes;
+        header.size = size;
+        header.levels = levels;
+        return header;
+    }
+
+    bool valid(uint32_t expected_elem_bytes) const {
+        return memcmp(magic, "SUFFIXAR", 8) == 0 && version == VERSION && elem_bytes == expected_elem_bytes &&
+            size >= 0 && size <= INT32_MAX && levels == expected_levels(size);
+    }
+
+    // sparse table levels build_lcp_rmq() makes for size rows: level k exists while 2^k <= blocks, level 0 always
+    static int64_t expected_levels(int64_t size) {
+        int64_t blocks = (size + 31) / 32, levels = 1;
+        while ((1ll << levels) <= blocks) ++levels;
+        return levels;
+    }
+
+    // rows of the k-th sparse table level over (size + 31) / 32 block minima
+    static int64_t level_length(int64_t size, int k) {
+        return (size + 31) / 32 - (1ll << k) + 1;
+    }
+
+    static uint64_t align(uint64_t offset) {
+        return (offset + ALIGN - 1) / ALIGN * ALIGN;
+    }
+};
+
+/**
+ * Read-only queries over a built suffix array. The arrays are borrowed: SuffixArray points them
+ * at its own vectors, MappedSuffixArray at a file mapping, so both answer queries with the same code.
+*/
+template <typename C>
+class SuffixArrayView {
+public:
+    int length() const {
+        return size;
+    }
+
+    /**
+     * [lo, hi) in sa of the suffixes starting with pattern, lo == hi if there is none.
+     * Binary search keeps the matched length against both ends of the range, and
+     * lcp(pattern, sa[mid]) >= min(llcp, rlcp), so each probe resumes from there instead of from 0.
+    */
+    pair<int, int> find(const vector<C> &pattern) const {
+        return find(pattern.data(), pattern.size(), -1);
+    }
+
+    int count(const vector<C> &pattern) const {
+        pair<int, int> range = find(pattern);
+        return range.second - range.first;
+    }
+
+    // start positions of pattern in sa order
+    vector<int> locate(const vector<C> &pattern) const {
+        pair<int, int> range = find(pattern);
+        return vector<int>(sa_data + range.first, sa_data + range.second);
+    }
+
+    /**
+     * Same as find() for every pattern, but patterns are visited in sorted order so that
+     * lower bounds only move forward and consecutive probes touch neighbouring rows of sa.
+    */
+    vector<pair<int, int>> find_batch(const vector<vector<C>> &patterns) const {
+        vector<int> order(patterns.size());
+        iota(order.begin(), order.end(), 0);
+        sort(order.begin(), order.end(), [&](int a, int b) { return patterns[a] < patterns[b]; });
+
+        vector<pair<int, int>> ranges(patterns.size());
+        int from = -1;
+        for (int idx: order) {
+            const vector<C> &p = patterns[idx];
+            ranges[idx] = find(p.data(), p.size(), from);
+            from = ranges[idx].first - 1;
+        }
+        return ranges;
+    }
+
+    // longest common prefix of the suffixes starting at i and j, O(1)
+    int lcp(int i, int j) const {
+        if (i == j) return size - i;
+        int a = rk_data[i], b = rk_data[j];
+        if (a > b) swap(a, b);
+        return lcp_range_min(a + 1, b);
+    }
+
+    /**
+     * Versioned image of the index, see SuffixArrayFileHeader.
+     * Every section is 64-byte aligned so MappedSuffixArray can use it in place.
+    */
+    void save(const string &path) const {
+        static_assert(is_trivially_copyable_v<C>, "only trivially copyable symbols can be saved");
+
+        int levels = lcp_block_min_data.size();
+        if (levels > SuffixArrayFileHeader::MAX_LEVELS) throw runtime_error("too many RMQ levels: " + path);
+
+        SuffixArrayFileHeader header = SuffixArrayFileHeader::make(sizeof(C), size, levels);
+        vector<pair<const void*, uint64_t>> sections = {
+            {elem_data, (uint64_t)size * sizeof(C)},
+            {rk_data, (uint64_t)size * sizeof(int)},
+            {sa_data, (uint64_t)size * sizeof(int)},
+            {lcp_data, (uint64_t)size * sizeof(int)},
+            {lcp_in_block_data, (uint64_t)size * sizeof(uint32_t)},
+        };
+        for (int k = 0; k < levels; ++k) {
+            sections.push_back({lcp_block_min_data[k], (uint64_t)SuffixArrayFileHeader::level_length(size, k) * sizeof(int)});
+        }
+
+        ofstream out(path, ios::binary | ios::trunc);
+        if (!out) throw runtime_error("cannot open for writing: " + path);
+        uint64_t offset = sizeof(header);
+        for (size_t i = 0; i < sections.size(); ++i) {
+            offset = SuffixArrayFileHeader::align(offset);
+            header.offsets[i] = offset;
+            offset += sections[i].second;
+        }
+        out.write((const char*)&header, sizeof(header));
+        uint64_t written = sizeof(header);
+        static const char zeros[SuffixArrayFileHeader::ALIGN] = {};
+        for (size_t i = 0; i < sections.size(); ++i) {
+            out.write(zeros, header.offsets[i] - written);
+            out.write((const char*)sections[i].first, sections[i].second);
+            written = header.offsets[i] + sections[i].second;
+        }
+        if (!out) throw runtime_error("write failed: " + path);
+    }
+
+protected:
+    explicit SuffixArrayView(int size = 0): size(size) {}
+
+    pair<int, int> find(const C *p, int m, int from) const {
+        int lo = bound(p, m, from, false);
+        return {lo, bound(p, m, lo - 1, true)};
+    }
+
+    // first row after `from` whose suffix is >= p (upper = false) or > every string starting with p (upper = true)
+    int bound(const C *p, int m, int from, bool upper) const {
+        int lo = from, hi = size;
+        int llcp = 0, rlcp = 0;
+        while (hi - lo > 1) {
+            int mid = lo + (hi - lo) / 2;
+            int pos = sa_data[mid];
+            int k = min(llcp, rlcp);
+            while (k < m && pos + k < size && elem_data[pos+k] == p[k]) ++k;
+
+            bool right;
+            if (k == m) right = upper;
+            else if (pos + k == size) right = true;
+            else right = elem_data[pos+k] < p[k];
+
+            if (right) {
+                lo = mid;
+                llcp = k;
+            }
+            else {
+                hi = mid;
+                rlcp = k;
+            }
+        }
+        return hi;
+    }
+
+    int lcp_in_block_min(int l, int r) const {
+        uint32_t stack = lcp_in_block_data[r] & (~0u << (l % 32));
+        return lcp_data[r / 32 * 32 + __builtin_ctz(stack)];
+    }
+
+    // min of sa_lcp[l..r], l <= r
+    int lcp_range_min(int l, int r) const {
+        int bl = l / 32, br = r / 32;
+        if (bl == br) return lcp_in_block_min(l, r);
+        int ans = min(lcp_in_block_min(l, bl * 32 + 31), lcp_in_block_min(br * 32, r));
+        if (bl + 1 < br) {
+            int k = 31 - __builtin_clz(br - bl - 1);
+            ans = min({ans, lcp_block_min_data[k][bl + 1], lcp_block_min_data[k][br - (1 << k)]});
+        }
+        return ans;
+    }
+
+    int size;
+    const C *elem_data = nullptr;
+    const int *rk_data = nullptr;
+    const int *sa_data = nullptr;
+    const int *lcp_data = nullptr;
+    const uint32_t *lcp_in_block_data = nullptr;
+    vector<const int*> lcp_block_min_data;
+};
+
 /**
  * https://oi-wiki.org/string/sa/
  * height[i] = LCP(sa[i], sa[i-1])
@@ -33,24 +262,33 @@ using namespace std;
  * 7  2  1           b  a  a  a  a  b
 */
 template <typename C>
-class SuffixArray {
+class SuffixArray : public SuffixArrayView<C> {
 public:
-    using Entry = struct { int k1, k2, idx; };
-    using EntrySorter = function<bool(const Entry&, const Entry&)>;
-    EntrySorter sorter = [](const Entry &e1, const Entry &e2) { return e1.k1 < e2.k1 || e1.k1 == e2.k1 && e1.k2 < e2.k2; };
+    /**
+     * DOUBLING: prefix doubling with radix sort, O(n log n)
+     * SAIS:     induced sorting (Nong, Zhang & Chan), O(n + |alphabet|)
+     * Both produce the same sa / rk / sa_lcp.
+     *
+     * threads > 1 splits every O(n) pass of a doubling round (k2 order, radix sort, re-ranking) and
+     * the LCP scan over that many threads; SA-IS itself stays sequential. Output never depends on threads.
+    */
+    enum class Mode { DOUBLING, SAIS };
 
-    SuffixArray(vector<C> &input): elem(input), size(input.size()), rk(input.size()), sa(input.size()), sa_lcp(input.size()) {
-        vector<Entry> entries;
-        int i = 0;
-        transform(input.begin(), input.end(), back_inserter(entries), [&i](const C &c) { 
-                return Entry{(int)c, 0, i++}; 
-            }
-        );
-        sort(entries.begin(), entries.end(), sorter);
-        refresh_rank(entries);
-        init_by_sort();
+    // input is copied into elem, pass an rvalue to hand the buffer over instead
+    SuffixArray(vector<C> input, Mode mode = Mode::DOUBLING, int threads = 1): 
+        SuffixArrayView<C>(input.size()), threads(max(threads, 1)), elem(move(input)), rk(elem.size()), sa(elem.size()), sa_lcp(elem.size()) {
+        if (mode == Mode::SAIS) init_by_sais();
+        else init_by_sort();
+        build_lcp_rmq();
+        bind_view();
     }
 
+    // the view borrows our buffers: moving keeps them, copying would not
+    SuffixArray(const SuffixArray&) = delete;
+    SuffixArray& operator= (const SuffixArray&) = delete;
+    SuffixArray(SuffixArray&&) = default;
+    SuffixArray& operator= (SuffixArray&&) = default;
+
     /**
      * a    a    b    a    a    a    a    b
      * 0    0    1    0    0    0    0    1
@@ -60,31 +298,61 @@ public:
      * 3    5    7    0    1    2    4    6
      * 3,1  5,2  7,4  0,6  1,-1 2,-1 4,-1 6,-1
      * 3    5    7    0    1    2    4    6 
+     *
+     * Each round is a two-pass LSD radix sort on (k1, k2) = (rk[i], rk[i+step]):
+     *   pass 1 (k2) comes for free from the previous sa: suffixes with k2 = -1 first, then sa[j] - step;
+     *   pass 2 (k1) is a stable counting sort over the ranks (an 11-bit digit LSD radix sort when threaded).
+     * All scratch buffers live across rounds, and we stop as soon as every rank is distinct.
     */
     void init_by_sort() {
-        vector<Entry> entries(size);
-        int step = 1;
-        while (step < size) {
-            for (int i = 0; i < size; ++i) {
-                entries[i] = {rk[i], i + step < size ? rk[i+step] : -1, i};
-            }
-            sort(entries.begin(), entries.end(), sorter);
-            refresh_rank(entries);
-            step <<= 1;
+        if (size == 0) return;
+
+        int upper = 0;
+        rk = compress_alphabet(upper);
+
+        vector<int> by_k2(size), old_rk(size), buf(size), cnt(max(upper + 1, size), 0);
+        iota(by_k2.begin(), by_k2.end(), 0);
+        sort_by_rank(by_k2, upper, buf, cnt);
+        int classes = refresh_rank(old_rk, 0, cnt);
+
+        for (int step = 1; classes < size; step <<= 1) {
+            refresh_k2_order(by_k2, step);
+            sort_by_rank(by_k2, classes - 1, buf, cnt);
+            classes = refresh_rank(old_rk, step, cnt);
         }
 
-        refresh_sa();
         refresh_sa_lcp();
     }
 
-    vector<int> get_sa() {
+    void init_by_sais() {
+        int upper = 0;
+        vector<int> s = compress_alphabet(upper);
+        sa = sa_is(s, upper);
+        parallel_for(size, [&](int, int lo, int hi) {
+            for (int i = lo; i < hi; ++i) rk[sa[i]] = i;
+        });
+        refresh_sa_lcp();
+    }
+
+    const vector<C>& get_elem() const {
+        return elem;
+    }
+
+    const vector<int>& get_sa() const {
         return sa;
     }
 
-    vector<int> get_sa_lcp() {
+    const vector<int>& get_sa_lcp() const {
         return sa_lcp;
     }
 
+    size_t memory_usage() const {
+        size_t bytes = elem.capacity() * sizeof(C) + (rk.capacity() + sa.capacity() + sa_lcp.capacity()) * sizeof(int);
+        bytes += lcp_in_block.capacity() * sizeof(uint32_t);
+        for (const vector<int> &level: lcp_block_min) bytes += level.capacity() * sizeof(int);
+        return bytes;
+    }
+
     void print() {
         cout <<"elem   = ";
         copy(elem.begin(), elem.end(), ostream_iterator<C>(std::cout, " "));
@@ -104,20 +372,295 @@ public:
     }
 
 private:
-    void refresh_rank(vector<Entry> &entries) {
-        for (int i = 0; i < size; ++i) {
-            Entry &entry = entries[i];
-            rk[entry.idx] = i == 0 ? 0 : 
-                (entry.k1 == entries[i-1].k1 && entry.k2 == entries[i-1].k2 ? rk[entries[i-1].idx] : (rk[entries[i-1].idx] + 1));
+    using SuffixArrayView<C>::size;
+
+    void bind_view() {
+        this->elem_data = elem.data();
+        this->rk_data = rk.data();
+        this->sa_data = sa.data();
+        this->lcp_data = sa_lcp.data();
+        this->lcp_in_block_data = lcp_in_block.data();
+        this->lcp_block_min_data.clear();
+        for (const vector<int> &level: lcp_block_min) this->lcp_block_min_data.push_back(level.data());
+    }
+
+    /**
+     * Map elem onto dense codes 0..upper keeping the order of C.
+     * Integral symbols spanning a range of at most max(n, 2^16) are bucketed directly,
+     * anything else goes through sort + unique.
+    */
+    vector<int> compress_alphabet(int &upper) {
+        vector<int> s(size);
+        if (size == 0) {
+            upper = 0;
+            return s;
+        }
+        bool bucketed = false;
+        if constexpr (is_integral_v<C> && sizeof(C) <= 4) {
+            auto bounds = minmax_element(elem.begin(), elem.end());
+            const long long low = *bounds.first, range = (long long)*bounds.second - low + 1;
+            if (range <= max<long long>(size, 1 << 16)) {
+                vector<int> code(range, 0);
+                for (const C &c: elem) code[c - low] = 1;
+                int next = 0;
+                for (int &x: code) x = x ? next++ : -1;
+                for (int i = 0; i < size; ++i) s[i] = code[elem[i] - low];
+                upper = next - 1;
+                bucketed = true;
+            }
+        }
+        if (!bucketed) {
+            vector<C> alphabet(elem);
+            sort(alphabet.begin(), alphabet.end());
+            alphabet.erase(unique(alphabet.begin(), alphabet.end()), alphabet.end());
+            for (int i = 0; i < size; ++i) {
+                s[i] = lower_bound(alphabet.begin(), alphabet.end(), elem[i]) - alphabet.begin();
+            }
+            upper = (int)alphabet.size() - 1;
+        }
+        return s;
+    }
+
+    /**
+     * SA-IS over s[i] in [0, upper].
+     * ls[i]: suffix i is S-type (smaller than suffix i+1), the last suffix is L-type.
+     * LMS: S-type with an L-type on the left. Once LMS suffixes are sorted, a left-to-right pass
+     * induces all L-types and a right-to-left pass induces all S-types.
+     * LMS substrings are named by a first induction, and if names collide, sorted by recursion.
+    */
+    static vector<int> sa_is(const vector<int> &s, int upper) {
+        int n = s.size();
+        if (n == 0) return {};
+        if (n == 1) return {0};
+        if (n == 2) return s[0] < s[1] ? vector<int>{0, 1} : vector<int>{1, 0};
+
+        vector<int> sa(n);
+        vector<bool> ls(n, false);
+        for (int i = n - 2; i >= 0; --i) {
+            ls[i] = s[i] == s[i+1] ? ls[i+1] : s[i] < s[i+1];
+        }
+
+        // bucket heads: sum_l[c] is the first slot of bucket c, sum_s[c] is the first S-type slot of bucket c
+        vector<int> sum_l(upper + 1, 0), sum_s(upper + 1, 0);
+        for (int i = 0; i < n; ++i) {
+            // an S-type symbol is never the largest one, so s[i]+1 <= upper
+            if (!ls[i]) ++sum_s[s[i]];
+            else ++sum_l[s[i]+1];
+        }
+        for (int c = 0; c <= upper; ++c) {
+            sum_s[c] += sum_l[c];
+            if (c < upper) sum_l[c+1] += sum_s[c];
+        }
+
+        vector<int> buf(upper + 1);
+        auto induce = [&](const vector<int> &lms) {
+            fill(sa.begin(), sa.end(), -1);
+            copy(sum_s.begin(), sum_s.end(), buf.begin());
+            for (int d: lms) {
+                sa[buf[s[d]]++] = d;
+            }
+            copy(sum_l.begin(), sum_l.end(), buf.begin());
+            sa[buf[s[n-1]]++] = n - 1;
+            for (int i = 0; i < n; ++i) {
+                int v = sa[i];
+                if (v >= 1 && !ls[v-1]) sa[buf[s[v-1]]++] = v - 1;
+            }
+            copy(sum_l.begin(), sum_l.end(), buf.begin());
+            for (int i = n - 1; i >= 0; --i) {
+                int v = sa[i];
+                if (v >= 1 && ls[v-1]) sa[--buf[s[v-1]+1]] = v - 1;
+            }
+        };
+
+        vector<int> lms_map(n + 1, -1), lms;
+        int m = 0;
+        for (int i = 1; i < n; ++i) {
+            if (!ls[i-1] && ls[i]) lms_map[i] = m++;
+        }
+        lms.reserve(m);
+        for (int i = 1; i < n; ++i) {
+            if (!ls[i-1] && ls[i]) lms.push_back(i);
+        }
+
+        induce(lms);
+
+        if (m) {
+            vector<int> sorted_lms;
+            sorted_lms.reserve(m);
+            for (int v: sa) {
+                if (lms_map[v] != -1) sorted_lms.push_back(v);
+            }
+
+            vector<int> rec_s(m);
+            int rec_upper = 0;
+            rec_s[lms_map[sorted_lms[0]]] = 0;
+            for (int i = 1; i < m; ++i) {
+                int l = sorted_lms[i-1], r = sorted_lms[i];
+                int end_l = lms_map[l] + 1 < m ? lms[lms_map[l]+1] : n;
+                int end_r = lms_map[r] + 1 < m ? lms[lms_map[r]+1] : n;
+                bool same = true;
+                if (end_l - l != end_r - r) {
+                    same = false;
+                }
+                else {
+                    while (l < end_l && s[l] == s[r]) {
+                        ++l;
+                        ++r;
+                    }
+                    if (l == n || s[l] != s[r]) same = false;
+                }
+                if (!same) ++rec_upper;
+                rec_s[lms_map[sorted_lms[i]]] = rec_upper;
+            }
+
+            vector<int> rec_sa = sa_is(rec_s, rec_upper);
+            for (int i = 0; i < m; ++i) {
+                sorted_lms[i] = lms[rec_sa[i]];
+            }
+            induce(sorted_lms);
         }
+        return sa;
     }
 
-    void refresh_sa() {
-        for (int i = 0; i < size; ++i) {
-            sa[rk[i]] = i;
+    /**
+     * O(n) space, O(1) query RMQ over sa_lcp.
+     * Rows are cut into blocks of 32. in_block[j] is the min-stack of j's block up to j as a bitmask,
+     * so the minimum of [l, j] inside a block sits at the lowest stack bit >= l.
+     * A sparse table over block minima covers whole blocks in between.
+    */
+    void build_lcp_rmq() {
+        int blocks = (size + 31) / 32;
+        lcp_in_block.assign(size, 0);
+        lcp_block_min.assign(1, vector<int>(blocks, INT32_MAX));
+        for (int j = 0; j < size; ++j) {
+            uint32_t stack = j % 32 == 0 ? 0 : lcp_in_block[j-1];
+            while (stack != 0 && sa_lcp[j / 32 * 32 + 31 - __builtin_clz(stack)] >= sa_lcp[j]) {
+                stack ^= 1u << (31 - __builtin_clz(stack));
+            }
+            lcp_in_block[j] = stack | 1u << (j % 32);
+            lcp_block_min[0][j / 32] = min(lcp_block_min[0][j / 32], sa_lcp[j]);
+        }
+        for (int k = 1; (1 << k) <= blocks; ++k) {
+            const vector<int> &prev = lcp_block_min[k-1];
+            vector<int> cur(blocks - (1 << k) + 1);
+            for (int b = 0; b < (int)cur.size(); ++b) {
+                cur[b] = min(prev[b], prev[b + (1 << (k - 1))]);
+            }
+            lcp_block_min.push_back(move(cur));
         }
     }
 
+    /**
+     * Run fn(t, lo, hi) on `threads` contiguous slices of [0, n).
+     * Chunking depends only on n, so two calls with the same n see the same slices.
+    */
+    template <typename F>
+    void parallel_for(int n, F fn) const {
+        if (threads == 1 || n < PARALLEL_GRAIN) {
+            fn(0, 0, n);
+            return;
+        }
+        int chunk = (n + threads - 1) / threads;
+        vector<thread> workers;
+        for (int t = 0; t < threads; ++t) {
+            int lo = min(n, t * chunk), hi = min(n, lo + chunk);
+            workers.emplace_back(fn, t, lo, hi);
+        }
+        for (thread &w: workers) w.join();
+    }
+
+    // order suffixes by k2: those running off the end (k2 = -1) first, then sa[j] - step in sa order
+    void refresh_k2_order(vector<int> &by_k2, int step) {
+        int head = min(step, size);
+        for (int k = 0; k < head; ++k) by_k2[k] = size - head + k;
+
+        vector<int> block(threads + 1, 0);
+        parallel_for(size, [&](int t, int lo, int hi) {
+            int c = 0;
+            for (int j = lo; j < hi; ++j) c += sa[j] >= step;
+            block[t+1] = c;
+        });
+        partial_sum(block.begin(), block.end(), block.begin());
+        parallel_for(size, [&](int t, int lo, int hi) {
+            int p = head + block[t];
+            for (int j = lo; j < hi; ++j) {
+                if (sa[j] >= step) by_k2[p++] = sa[j] - step;
+            }
+        });
+    }
+
+    // stable sort of order by rk[], written into sa; order and buf are left as scratch
+    void sort_by_rank(vector<int> &order, int upper, vector<int> &buf, vector<int> &cnt) {
+        if (threads == 1) {
+            fill(cnt.begin(), cnt.begin() + upper + 1, 0);
+            for (int i = 0; i < size; ++i) ++cnt[rk[i]];
+            for (int r = 1; r <= upper; ++r) cnt[r] += cnt[r-1];
+            for (int j = size - 1; j >= 0; --j) {
+                sa[--cnt[rk[order[j]]]] = order[j];
+            }
+            return;
+        }
+
+        // per-thread histograms of an 11-bit digit, one LSD pass per digit
+        const int BITS = 11, BUCKETS = 1 << BITS;
+        int width = 0;
+        while (width < 31 && (upper >> width) > 0) ++width;
+
+        vector<int> hist(threads * BUCKETS);
+        vector<int> *src = &order, *dst = &buf;
+        for (int shift = 0; shift < width; shift += BITS) {
+            fill(hist.begin(), hist.end(), 0);
+            parallel_for(size, [&](int t, int lo, int hi) {
+                int *h = &hist[t * BUCKETS];
+                for (int j = lo; j < hi; ++j) ++h[(rk[(*src)[j]] >> shift) & (BUCKETS - 1)];
+            });
+            int sum = 0;
+            for (int b = 0; b < BUCKETS; ++b) {
+                for (int t = 0; t < threads; ++t) {
+                    int c = hist[t * BUCKETS + b];
+                    hist[t * BUCKETS + b] = sum;
+                    sum += c;
+                }
+            }
+            parallel_for(size, [&](int t, int lo, int hi) {
+                int *h = &hist[t * BUCKETS];
+                for (int j = lo; j < hi; ++j) {
+                    int v = (*src)[j];
+                    (*dst)[h[(rk[v] >> shift) & (BUCKETS - 1)]++] = v;
+                }
+            });
+            swap(src, dst);
+        }
+        sa.swap(*src);
+    }
+
+    // re-rank by (rk[i], rk[i+step]) along sa, returns the number of distinct ranks
+    int refresh_rank(vector<int> &old_rk, int step, vector<int> &mark) {
+        rk.swap(old_rk);
+        auto k2 = [&](int i) { return i + step < size ? old_rk[i+step] : -1; };
+
+        // mark[j] = 1 if sa[j] starts a new rank, then a blocked prefix sum over mark
+        vector<int> block(threads + 1, 0);
+        parallel_for(size, [&](int t, int lo, int hi) {
+            int c = 0;
+            for (int j = max(lo, 1); j < hi; ++j) {
+                int cur = sa[j], prev = sa[j-1];
+                mark[j] = old_rk[cur] != old_rk[prev] || (step > 0 && k2(cur) != k2(prev));
+                c += mark[j];
+            }
+            block[t+1] = c;
+        });
+        partial_sum(block.begin(), block.end(), block.begin());
+        parallel_for(size, [&](int t, int lo, int hi) {
+            int r = block[t];
+            for (int j = lo; j < hi; ++j) {
+                if (j > 0) r += mark[j];
+                rk[sa[j]] = r;
+            }
+        });
+        return block[threads] + 1;
+    }
+
     /*
                    i-1  i
                     a   b ...
@@ -131,10 +674,17 @@ private:
         sa_lcp[rk[i]] >= sa_lcp[rk[i-1]] - 1
         sa_lcp[rk[i]] = lcp(sa[rk[i]], sa[rk[i]-1]) = lcp(i, sa[rk[i]-1]), sa[rk[i]-1] is the previous suffix of i
         sa_lcp[rk[i-1]] = lcp(sa[rk[i-1]], sa[rk[i-1]-1]) = lcp(i-1, sa[rk[i-1]-1]), sa[rk[i-1]-1] is the previous suffix of i - 1
+
+        The bound only saves work, so each thread runs the same scan over its own range of idx
+        starting from common_len = 0 and gets exactly the sequential result.
     */
     void refresh_sa_lcp() {
+        parallel_for(size, [&](int, int lo, int hi) { refresh_sa_lcp(lo, hi); });
+    }
+
+    void refresh_sa_lcp(int lo, int hi) {
         int common_len = 0;
-        for (int idx = 0; idx < size; ++idx) {
+        for (int idx = lo; idx < hi; ++idx) {
             int sa_idx = rk[idx];
 
             if (sa_idx == 0) {
@@ -153,11 +703,753 @@ private:
         }
     }
 
-    int size;
+    static const int PARALLEL_GRAIN = 1 << 14;
+
+    int threads;
     vector<C> elem;
     vector<int> rk;
     vector<int> sa;
     vector<int> sa_lcp;
+    vector<uint32_t> lcp_in_block;
+    vector<vector<int>> lcp_block_min;
+};
+
+/**
+ * Suffix array over a collection of strings, e.g. {"banana", "ananas"} is indexed as
+ *   b a n a n a #0 a n a n a s #1
+ * Every string gets its own separator. Separators are distinct and smaller than every symbol,
+ * so no common prefix runs across a boundary and a pattern never matches one.
+ * Symbols are remapped to ints: the separator of document d is d, symbol c is documents + rank(c).
+ * The int text is built once and moved into the SuffixArray.
+ * doc_array[row] is the document of the suffix at sa[row].
+*/
+template <typename C>
+class GeneralizedSuffixArray {
+public:
+    using Mode = typename SuffixArray<int>::Mode;
+
+    // docs: any range of ranges of C, e.g. vector<string> or vector<vector<C>>
+    template <typename Docs>
+    explicit GeneralizedSuffixArray(const Docs &docs, Mode mode = Mode::SAIS, int threads = 1):
+        index(concat(docs), mode, threads) {
+        const vector<int> &sa = index.get_sa();
+        doc_array.resize(sa.size());
+        for (size_t row = 0; row < sa.size(); ++row) {
+            doc_array[row] = document(sa[row]);
+        }
+    }
+
+    int documents() const {
+        return (int)doc_start.size() - 1;
+    }
+
+    // document of a text position, separators belong to the string they terminate
+    int document(int pos) const {
+        return int(upper_bound(doc_start.begin(), doc_start.end(), pos) - doc_start.begin()) - 1;
+    }
+
+    const SuffixArray<int>& get_index() const {
+        return index;
+    }
+
+    const vector<int>& get_doc_array() const {
+        return doc_array;
+    }
+
+    /**
+     * Rows of the suffixes starting with pattern. The separators sort first, one row each, so the empty
+     * pattern gets the rows after them: like SuffixArray::find(), every position inside a document.
+    */
+    pair<int, int> find(const vector<C> &pattern) const {
+        if (pattern.empty()) return {documents(), index.length()};
+        vector<int> codes(pattern.size());
+        for (size_t k = 0; k < pattern.size(); ++k) {
+            int c = code(pattern[k]);
+            if (c < 0) return {0, 0};
+            codes[k] = documents() + c;
+        }
+        return index.find(codes);
+    }
+
+    int count(const vector<C> &pattern) const {
+        pair<int, int> range = find(pattern);
+        return range.second - range.first;
+    }
+
+    // (document, offset in document) of every occurrence, in sa order
+    vector<pair<int, int>> locate(const vector<C> &pattern) const {
+        pair<int, int> range = find(pattern);
+        const vector<int> &sa = index.get_sa();
+        vector<pair<int, int>> occ;
+        occ.reserve(range.second - range.first);
+        for (int row = range.first; row < range.second; ++row) {
+            occ.push_back({doc_array[row], sa[row] - doc_start[doc_array[row]]});
+        }
+        return occ;
+    }
+
+    // ascending ids of the documents containing pattern, all of them for the empty pattern
+    vector<int> list_documents(const vector<C> &pattern) const {
+        if (pattern.empty()) {
+            vector<int> ids(documents());
+            iota(ids.begin(), ids.end(), 0);
+            return ids;
+        }
+        pair<int, int> range = find(pattern);
+        vector<int> ids(doc_array.begin() + range.first, doc_array.begin() + range.second);
+        sort(ids.begin(), ids.end());
+        ids.erase(unique(ids.begin(), ids.end()), ids.end());
+        return ids;
+    }
+
+private:
+    template <typename Docs>
+    vector<int> concat(const Docs &docs) {
+        size_t total = 0;
+        for (const auto &doc: docs) {
+            for (const C &c: doc) alphabet.push_back(c);
+            total += distance(begin(doc), end(doc)) + 1;
+            doc_start.push_back(total);
+        }
+        sort(alphabet.begin(), alphabet.end());
+        alphabet.erase(unique(alphabet.begin(), alphabet.end()), alphabet.end());
+        alphabet.shrink_to_fit();
+        doc_start.insert(doc_start.begin(), 0);
+
+        int d = 0;
+        vector<int> text;
+        text.reserve(total);
+        for (const auto &doc: docs) {
+            for (const C &c: doc) text.push_back(documents() + code(c));
+            text.push_back(d++);
+        }
+        return text;
+    }
+
+    // rank of c among the symbols seen, -1 if absent
+    int code(const C &c) const {
+        auto it = lower_bound(alphabet.begin(), alphabet.end(), c);
+        return it != alphabet.end() && !(c < *it) ? int(it - alphabet.begin()) : -1;
+    }
+
+    vector<C> alphabet;
+    vector<int> doc_start;
+    SuffixArray<int> index;
+    vector<int> doc_array;
+};
+
+/**
+ * A file written by SuffixArrayView::save(), mapped read-only.
+ * Opening only validates the header, queries page the arrays in on demand.
+*/
+template <typename C>
+class MappedSuffixArray : public SuffixArrayView<C> {
+public:
+    explicit MappedSuffixArray(const string &path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw runtime_error("cannot open: " + path);
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SuffixArrayFileHeader)) {
+            close(fd);
+            throw runtime_error("not a suffix array file: " + path);
+        }
+        mapped_bytes = st.st_size;
+        mapped = mmap(nullptr, mapped_bytes, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED) throw runtime_error("mmap failed: " + path);
+
+        const SuffixArrayFileHeader &header = *(const SuffixArrayFileHeader*)mapped;
+        if (!header.valid(sizeof(C))) {
+            munmap(mapped, mapped_bytes);
+            throw runtime_error("incompatible suffix array file: " + path);
+        }
+
+        int64_t n = header.size;
+        vector<uint64_t> lengths = {n * sizeof(C), n * sizeof(int), n * sizeof(int), n * sizeof(int), n * sizeof(uint32_t)};
+        for (int k = 0; k < header.levels; ++k) {
+            lengths.push_back(SuffixArrayFileHeader::level_length(n, k) * sizeof(int));
+        }
+        for (size_t i = 0; i < lengths.size(); ++i) {
+            if (header.offsets[i] % SuffixArrayFileHeader::ALIGN != 0 || lengths[i] > mapped_bytes ||
+                header.offsets[i] > mapped_bytes - lengths[i]) {
+                munmap(mapped, mapped_bytes);
+                throw runtime_error("truncated suffix array file: " + path);
+            }
+        }
+
+        const char *base = (const char*)mapped;
+        this->size = n;
+        this->elem_data = (const C*)(base + header.offsets[0]);
+        this->rk_data = (const int*)(base + header.offsets[1]);
+        this->sa_data = (const int*)(base + header.offsets[2]);
+        this->lcp_data = (const int*)(base + header.offsets[3]);
+        this->lcp_in_block_data = (const uint32_t*)(base + header.offsets[4]);
+        for (int k = 0; k < header.levels; ++k) {
+            this->lcp_block_min_data.push_back((const int*)(base + header.offsets[5 + k]));
+        }
+    }
+
+    MappedSuffixArray(const MappedSuffixArray&) = delete;
+    MappedSuffixArray& operator= (const MappedSuffixArray&) = delete;
+
+    ~MappedSuffixArray() {
+        munmap(mapped, mapped_bytes);
+    }
+
+private:
+    void *mapped = nullptr;
+    size_t mapped_bytes = 0;
+};
+
+// buffered sequential writer of trivially copyable records
+template <typename R>
+class RecordWriter {
+public:
+    explicit RecordWriter(const string &path, size_t buffer_records = 1 << 14): path(path), file(fopen(path.c_str(), "wb")) {
+        if (file == nullptr) throw runtime_error("cannot open for writing: " + path);
+        buffer.reserve(buffer_records);
+    }
+
+    RecordWriter(const RecordWriter&) = delete;
+    RecordWriter& operator= (const RecordWriter&) = delete;
+
+    ~RecordWriter() {
+        if (file != nullptr) fclose(file);
+    }
+
+    void push(const R &r) {
+        buffer.push_back(r);
+        if (buffer.size() == buffer.capacity()) flush();
+    }
+
+    void close() {
+        flush();
+        if (fclose(file) != 0) {
+            file = nullptr;
+            throw runtime_error("close failed: " + path);
+        }
+        file = nullptr;
+    }
+
+private:
+    void flush() {
+        if (fwrite(buffer.data(), sizeof(R), buffer.size(), file) != buffer.size()) {
+            throw runtime_error("write failed: " + path);
+        }
+        buffer.clear();
+    }
+
+    string path;
+    FILE *file;
+    vector<R> buffer;
+};
+
+// buffered sequential reader of trivially copyable records, optionally starting at record `skip`
+template <typename R>
+class RecordReader {
+public:
+    explicit RecordReader(const string &path, size_t buffer_records = 1 << 14, uint64_t skip = 0): 
+        path(path), file(fopen(path.c_str(), "rb")), buffer(max<size_t>(buffer_records, 1)) {
+        if (file == nullptr) throw runtime_error("cannot open: " + path);
+        if (skip > 0 && fseeko(file, (off_t)(skip * sizeof(R)), SEEK_SET) != 0) {
+            fclose(file);
+            throw runtime_error("seek failed: " + path);
+        }
+    }
+
+    RecordReader(const RecordReader&) = delete;
+    RecordReader& operator= (const RecordReader&) = delete;
+
+    ~RecordReader() {
+        fclose(file);
+    }
+
+    bool next(R &r) {
+        if (pos == filled) {
+            filled = fread(buffer.data(), sizeof(R), buffer.size(), file);
+            pos = 0;
+            if (filled == 0) {
+                if (ferror(file)) throw runtime_error("read failed: " + path);
+                return false;
+            }
+        }
+        r = buffer[pos++];
+        return true;
+    }
+
+private:
+    string path;
+    FILE *file;
+    vector<R> buffer;
+    size_t pos = 0, filled = 0;
+};
+
+// shared by every ExternalSorter instantiation and ExternalSuffixArray build, so temporaries of
+// concurrent builds in one process never collide in a shared work_dir
+inline atomic<uint64_t> external_sorter_run_id(0);
+
+/**
+ * External merge sort within memory_budget bytes of records.
+ * push() fills a buffer, a full buffer is sorted and spilled as a run under work_dir.
+ * drain() merges the runs (in several passes if there are more than fit the budget
+ * with 4096-record read buffers each) and hands every record to fn in order.
+ * If nothing was spilled, drain() sorts in memory and never touches the disk.
+*/
+template <typename R, typename Less>
+class ExternalSorter {
+public:
+    ExternalSorter(const string &work_dir, size_t memory_budget, Less less = Less()):
+        work_dir(work_dir), capacity(max<size_t>(memory_budget / sizeof(R), 1)), less(less) {
+        fan_in = max<size_t>(capacity / 4096, 2);
+    }
+
+    ExternalSorter(const ExternalSorter&) = delete;
+    ExternalSorter& operator= (const ExternalSorter&) = delete;
+
+    ~ExternalSorter() {
+        for (const string &run: runs) remove(run.c_str());
+    }
+
+    void push(const R &r) {
+        if (buffer.capacity() < capacity) buffer.reserve(capacity);
+        buffer.push_back(r);
+        if (buffer.size() == capacity) spill();
+    }
+
+    template <typename F>
+    void drain(F fn) {
+        if (runs.empty()) {
+            sort(buffer.begin(), buffer.end(), less);
+            for (const R &r: buffer) fn(r);
+            vector<R>().swap(buffer);
+            return;
+        }
+        if (!buffer.empty()) spill();
+        vector<R>().swap(buffer);
+
+        while (runs.size() > fan_in) {
+            vector<string> group(runs.begin(), runs.begin() + fan_in);
+            runs.erase(runs.begin(), runs.begin() + fan_in);
+            string merged = next_run_path();
+            RecordWriter<R> out(merged);
+            merge(group, [&](const R &r) { out.push(r); });
+            out.close();
+            runs.push_back(merged);
+        }
+        vector<string> group;
+        group.swap(runs);
+        merge(group, fn);
+    }
+
+private:
+    string next_run_path() {
+        return work_dir + "/sa_run_" + to_string(getpid()) + "_" + to_string(external_sorter_run_id++);
+    }
+
+    void spill() {
+        sort(buffer.begin(), buffer.end(), less);
+        string path = next_run_path();
+        RecordWriter<R> out(path);
+        runs.push_back(path);
+        for (const R &r: buffer) out.push(r);
+        out.close();
+        buffer.clear();
+    }
+
+    // k-way merge of the given runs, which are deleted afterwards
+    template <typename F>
+    void merge(const vector<string> &inputs, F fn) {
+        size_t per_run = max<size_t>(capacity / inputs.size(), 1);
+        vector<unique_ptr<RecordReader<R>>> readers;
+        auto greater = [&](const pair<R, int> &a, const pair<R, int> &b) { return less(b.first, a.first); };
+        priority_queue<pair<R, int>, vector<pair<R, int>>, decltype(greater)> heap(greater);
+        for (size_t k = 0; k < inputs.size(); ++k) {
+            readers.emplace_back(new RecordReader<R>(inputs[k], per_run));
+            R r;
+            if (readers[k]->next(r)) heap.push({r, (int)k});
+        }
+        while (!heap.empty()) {
+            pair<R, int> top = heap.top();
+            heap.pop();
+            fn(top.first);
+            R r;
+            if (readers[top.second]->next(r)) heap.push({r, top.second});
+        }
+        readers.clear();
+        for (const string &run: inputs) remove(run.c_str());
+    }
+
+    string work_dir;
+    size_t capacity, fan_in;
+    Less less;
+    vector<R> buffer;
+    vector<string> runs;
+};
+
+// read-only mapping of a raw array of T, e.g. the sa / lcp files of ExternalSuffixArray
+template <typename T>
+class MappedArray {
+public:
+    explicit MappedArray(const string &path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw runtime_error("cannot open: " + path);
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            throw runtime_error("cannot stat: " + path);
+        }
+        mapped_bytes = st.st_size;
+        if (mapped_bytes > 0) {
+            mapped = mmap(nullptr, mapped_bytes, PROT_READ, MAP_SHARED, fd, 0);
+            if (mapped == MAP_FAILED) {
+                close(fd);
+                throw runtime_error("mmap failed: " + path);
+            }
+        }
+        close(fd);
+    }
+
+    MappedArray(const MappedArray&) = delete;
+    MappedArray& operator= (const MappedArray&) = delete;
+
+    ~MappedArray() {
+        if (mapped != nullptr) munmap(mapped, mapped_bytes);
+    }
+
+    uint64_t size() const { return mapped_bytes / sizeof(T); }
+    const T& operator[] (uint64_t i) const { return ((const T*)mapped)[i]; }
+
+private:
+    void *mapped = nullptr;
+    size_t mapped_bytes = 0;
+};
+
+/**
+ * Suffix array and LCP of a byte file that does not fit in memory, ordered by unsigned byte value.
+ * Positions are uint64_t, sa_path and lcp_path receive raw uint64_t arrays indexed by row.
+ *
+ * Prefix doubling over external sorts, with names instead of dense ranks:
+ *   name file (text order) -> (name[i], name[i+step], i) sorted by key -> new names + sa candidate
+ *                          -> (i, new name) sorted by i -> next name file
+ * A new name is 1 + the row of the first suffix of its group (0 means past the end), so once every
+ * name is distinct, the candidate written along the way is sa and name[i] - 1 is the rank.
+ * LCP is Kasai over Phi: Phi[sa[j]] = sa[j-1] sorted into text order gives PLCP in one pass over
+ * the memory-mapped text, and (rank, plcp) sorted back gives lcp by row.
+ * At most two sorters are alive at a time, each gets half of memory_budget.
+*/
+class ExternalSuffixArray {
+public:
+    ExternalSuffixArray(const string &text_path, const string &work_dir, size_t memory_budget):
+        text_path(text_path), work_dir(work_dir), memory_budget(memory_budget) {}
+
+    void build(const string &sa_path, const string &lcp_path) {
+        string name_path = work_dir + "/sa_names_" + to_string(getpid()) + "_" + to_string(external_sorter_run_id++);
+        uint64_t n = init_names(name_path);
+        for (uint64_t step = 1; ; step <<= 1) {
+            if (refine_names(name_path, sa_path, n, step) == n) break;
+        }
+        build_lcp(name_path, sa_path, lcp_path, n);
+        remove(name_path.c_str());
+    }
+
+private:
+    struct Key { uint64_t k1, k2, idx; };
+    struct ByKey {
+        bool operator() (const Key &a, const Key &b) const { return a.k1 < b.k1 || (a.k1 == b.k1 && a.k2 < b.k2); }
+    };
+    struct Pair { uint64_t first, second; };
+    struct ByFirst {
+        bool operator() (const Pair &a, const Pair &b) const { return a.first < b.first; }
+    };
+
+    uint64_t init_names(const string &name_path) {
+        RecordReader<unsigned char> in(text_path);
+        RecordWriter<uint64_t> out(name_path);
+        uint64_t n = 0;
+        unsigned char c;
+        while (in.next(c)) {
+            out.push((uint64_t)c + 1);
+            ++n;
+        }
+        out.close();
+        return n;
+    }
+
+    // one doubling round, returns the number of distinct names
+    uint64_t refine_names(const string &name_path, const string &sa_path, uint64_t n, uint64_t step) {
+        ExternalSorter<Key, ByKey> by_key(work_dir, memory_budget / 2);
+        {
+            RecordReader<uint64_t> k1(name_path), k2(name_path, 1 << 14, min(step, n));
+            for (uint64_t i = 0; i < n; ++i) {
+                Key key{0, 0, i};
+                k1.next(key.k1);
+                if (i + step < n) k2.next(key.k2);
+                by_key.push(key);
+            }
+        }
+
+        ExternalSorter<Pair, ByFirst> by_pos(work_dir, memory_budget / 2);
+        RecordWriter<uint64_t> sa_out(sa_path);
+        uint64_t row = 0, name = 0, distinct = 0;
+        Key prev{0, 0, 0};
+        by_key.drain([&](const Key &key) {
+            if (row == 0 || key.k1 != prev.k1 || key.k2 != prev.k2) {
+                name = row + 1;
+                ++distinct;
+            }
+            by_pos.push({key.idx, name});
+            sa_out.push(key.idx);
+            prev = key;
+            ++row;
+        });
+        sa_out.close();
+
+        RecordWriter<uint64_t> name_out(name_path);
+        by_pos.drain([&](const Pair &p) { name_out.push(p.second); });
+        name_out.close();
+        return distinct;
+    }
+
+    void build_lcp(const string &name_path, const string &sa_path, const string &lcp_path, uint64_t n) {
+        ExternalSorter<Pair, ByFirst> phi(work_dir, memory_budget / 2);
+        {
+            RecordReader<uint64_t> sa_in(sa_path);
+            uint64_t prev = 0, cur;
+            for (uint64_t row = 0; sa_in.next(cur); ++row) {
+                if (row > 0) phi.push({cur, prev});
+                prev = cur;
+            }
+        }
+
+        MappedArray<unsigned char> text(text_path);
+        RecordReader<uint64_t> names(name_path);
+        ExternalSorter<Pair, ByFirst> by_row(work_dir, memory_budget / 2);
+        uint64_t i = 0, l = 0, name;
+        // Phi is missing only for sa[0], whose lcp is 0
+        auto emit = [&](uint64_t plcp) {
+            names.next(name);
+            by_row.push({name - 1, plcp});
+            ++i;
+        };
+        phi.drain([&](const Pair &p) {
+            while (i < p.first) {
+                l = 0;
+                emit(0);
+            }
+            while (i + l < n && p.second + l < n && text[i+l] == text[p.second+l]) ++l;
+            emit(l);
+            if (l > 0) --l;
+        });
+        while (i < n) emit(0);
+
+        RecordWriter<uint64_t> lcp_out(lcp_path);
+        by_row.drain([&](const Pair &p) { lcp_out.push(p.second); });
+        lcp_out.close();
+    }
+
+    string text_path, work_dir;
+    size_t memory_budget;
+};
+
+// rank1 in O(1): one cumulative count per 512 bits (6.25% overhead) plus up to 8 popcounts
+class BitVector {
+public:
+    BitVector(int n = 0): n(n), words(n / 64 + 1, 0) {}
+
+    void set(int i) { words[i >> 6] |= 1ull << (i & 63); }
+    bool get(int i) const { return words[i >> 6] >> (i & 63) & 1; }
+
+    void build() {
+        blocks.assign((words.size() + 7) / 8, 0);
+        uint32_t sum = 0;
+        for (size_t w = 0; w < words.size(); ++w) {
+            if (w % 8 == 0) blocks[w / 8] = sum;
+            sum += __builtin_popcountll(words[w]);
+        }
+    }
+
+    // ones in [0, i)
+    int rank1(int i) const {
+        int w = i >> 6;
+        int r = blocks[w >> 3];
+        for (int k = w & ~7; k < w; ++k) r += __builtin_popcountll(words[k]);
+        return r + __builtin_popcountll(words[w] & ((1ull << (i & 63)) - 1));
+    }
+
+    int rank0(int i) const { return i - rank1(i); }
+
+    size_t memory_usage() const { return words.capacity() * sizeof(uint64_t) + blocks.capacity() * sizeof(uint32_t); }
+
+private:
+    int n;
+    vector<uint64_t> words;
+    vector<uint32_t> blocks;
+};
+
+/**
+ * Values in [0, 2^bits) as `bits` bit vectors. Level l holds bit l of every value, with values
+ * stably partitioned by the higher bits (zeros first), so rank(c, i) is one rank1 per level.
+*/
+class WaveletMatrix {
+public:
+    WaveletMatrix(): n(0) {}
+
+    WaveletMatrix(vector<int> v, int bits): n(v.size()), levels(bits), zeros(bits) {
+        vector<int> next(n);
+        for (int l = bits - 1; l >= 0; --l) {
+            levels[l] = BitVector(n);
+            for (int i = 0; i < n; ++i) {
+                if (v[i] >> l & 1) levels[l].set(i);
+            }
+            levels[l].build();
+            zeros[l] = levels[l].rank0(n);
+            stable_partition_copy(v, next, l);
+            v.swap(next);
+        }
+    }
+
+    int access(int i) const {
+        int c = 0;
+        for (int l = (int)levels.size() - 1; l >= 0; --l) {
+            if (levels[l].get(i)) {
+                c |= 1 << l;
+                i = zeros[l] + levels[l].rank1(i);
+            }
+            else {
+                i = levels[l].rank0(i);
+            }
+        }
+        return c;
+    }
+
+    // occurrences of c in [0, i)
+    int rank(int c, int i) const {
+        int s = 0;
+        for (int l = (int)levels.size() - 1; l >= 0; --l) {
+            if (c >> l & 1) {
+                s = zeros[l] + levels[l].rank1(s);
+                i = zeros[l] + levels[l].rank1(i);
+            }
+            else {
+                s = levels[l].rank0(s);
+                i = levels[l].rank0(i);
+            }
+        }
+        return i - s;
+    }
+
+    size_t memory_usage() const {
+        size_t bytes = zeros.capacity() * sizeof(int);
+        for (const BitVector &level: levels) bytes += level.memory_usage();
+        return bytes;
+    }
+
+private:
+    static void stable_partition_copy(const vector<int> &from, vector<int> &to, int l) {
+        int p = 0;
+        for (int x: from) if (!(x >> l & 1)) to[p++] = x;
+        for (int x: from) if (x >> l & 1) to[p++] = x;
+    }
+
+    int n;
+    vector<BitVector> levels;
+    vector<int> zeros;
+};
+
+/**
+ * FM-index of text$ derived from a built SuffixArray.
+ * row 0 is the suffix "$", row r > 0 is sa[r-1]; bwt[row] = text[pos-1] or $ (code 0) for pos 0.
+ * Symbols are remapped to 1..sigma, so the BWT takes ceil(log2(sigma+1)) bits per symbol.
+ * Every sample_rate-th text position is kept in SA order; locate walks LF until it hits one.
+*/
+template <typename C>
+class FMIndex {
+public:
+    FMIndex(const SuffixArray<C> &index, int sample_rate = 32): size(index.get_elem().size()), sample_rate(sample_rate) {
+        const vector<C> &text = index.get_elem();
+        const vector<int> &sa = index.get_sa();
+
+        alphabet = text;
+        sort(alphabet.begin(), alphabet.end());
+        alphabet.erase(unique(alphabet.begin(), alphabet.end()), alphabet.end());
+        alphabet.shrink_to_fit();
+        int sigma = alphabet.size();
+        int bits = 1;
+        while ((1 << bits) <= sigma) ++bits;
+
+        vector<int> bwt(size + 1);
+        counts.assign(sigma + 2, 0);
+        sampled = BitVector(size + 1);
+        for (int row = 0; row <= size; ++row) {
+            int pos = row == 0 ? size : sa[row-1];
+            bwt[row] = pos == 0 ? 0 : code(text[pos-1]);
+            ++counts[bwt[row] + 1];
+            if (pos % sample_rate == 0 || pos == size) {
+                sampled.set(row);
+                samples.push_back(pos);
+            }
+        }
+        partial_sum(counts.begin(), counts.end(), counts.begin());
+        sampled.build();
+        samples.shrink_to_fit();
+        wavelet = WaveletMatrix(move(bwt), bits);
+    }
+
+    // [lo, hi) of rows prefixed by pattern, by backward search; row 0 is the "$" suffix, which only the
+    // empty pattern would match, so it starts from row 1 and count("") is size as in SuffixArray
+    pair<int, int> find(const vector<C> &pattern) const {
+        int lo = pattern.empty() ? 1 : 0, hi = size + 1;
+        for (int k = (int)pattern.size() - 1; k >= 0 && lo < hi; --k) {
+            int c = code(pattern[k]);
+            if (c < 0) return {0, 0};
+            lo = counts[c] + wavelet.rank(c, lo);
+            hi = counts[c] + wavelet.rank(c, hi);
+        }
+        return lo < hi ? make_pair(lo, hi) : make_pair(0, 0);
+    }
+
+    int count(const vector<C> &pattern) const {
+        pair<int, int> range = find(pattern);
+        return range.second - range.first;
+    }
+
+    // start positions of pattern in row order
+    vector<int> locate(const vector<C> &pattern) const {
+        pair<int, int> range = find(pattern);
+        vector<int> occ;
+        occ.reserve(range.second - range.first);
+        for (int row = range.first; row < range.second; ++row) occ.push_back(position(row));
+        return occ;
+    }
+
+    size_t memory_usage() const {
+        return wavelet.memory_usage() + sampled.memory_usage() + samples.capacity() * sizeof(int) +
+            counts.capacity() * sizeof(int) + alphabet.capacity() * sizeof(C);
+    }
+
+private:
+    int code(const C &c) const {
+        auto it = lower_bound(alphabet.begin(), alphabet.end(), c);
+        return it != alphabet.end() && !(c < *it) ? int(it - alphabet.begin()) + 1 : -1;
+    }
+
+    int position(int row) const {
+        int steps = 0;
+        while (!sampled.get(row)) {
+            int c = wavelet.access(row);
+            row = counts[c] + wavelet.rank(c, row);
+            ++steps;
+        }
+        return samples[sampled.rank1(row)] + steps;
+    }
+
+    int size;
+    int sample_rate;
+    vector<C> alphabet;
+    vector<int> counts;
+    WaveletMatrix wavelet;
+    BitVector sampled;
+    vector<int> samples;
 };
 
 inline vector<char> convert(const string &s) {
@@ -168,9 +1460,311 @@ inline vector<char> convert(const string &s) {
     return v;
 }
 
-int main() {
+namespace bench {
+
+using Clock = chrono::steady_clock;
+
+inline double elapsed_ms(Clock::time_point from) {
+    return chrono::duration<double, milli>(Clock::now() - from).count();
+}
+
+inline vector<char> random_text(int n, mt19937 &rng) {
+    uniform_int_distribution<int> dist('a', 'z');
+    vector<char> v(n);
+    for (char &c: v) c = (char)dist(rng);
+    return v;
+}
+
+inline vector<char> periodic_text(int n) {
+    return vector<char>(n, 'a');
+}
+
+// word salad with an English-like word frequency skew
+inline vector<char> natural_text(int n, mt19937 &rng) {
+    static const char *words[] = {
+        "the", "of", "and", "to", "in", "a", "is", "that", "for", "it", "as", "was", "with", "be", "by",
+        "on", "not", "he", "this", "are", "or", "his", "from", "at", "which", "but", "have", "an", "had",
+        "they", "you", "were", "their", "one", "all", "we", "can", "her", "has", "there", "been", "if",
+        "more", "when", "will", "would", "who", "so", "no", "request", "server", "error", "timeout",
+    };
+    const int cnt = sizeof(words) / sizeof(words[0]);
+    geometric_distribution<int> dist(0.15);
+    vector<char> v;
+    v.reserve(n + 16);
+    while ((int)v.size() < n) {
+        const char *w = words[min(dist(rng), cnt - 1)];
+        v.insert(v.end(), w, w + strlen(w));
+        v.push_back(' ');
+    }
+    v.resize(n);
+    return v;
+}
+
+template <typename C>
+void compare_modes(const string &name, vector<C> &text) {
+    auto t0 = Clock::now();
+    SuffixArray<C> doubling(text, SuffixArray<C>::Mode::DOUBLING);
+    double doubling_ms = elapsed_ms(t0);
+
+    t0 = Clock::now();
+    SuffixArray<C> sais(text, SuffixArray<C>::Mode::SAIS);
+    double sais_ms = elapsed_ms(t0);
+
+    bool same = doubling.get_sa() == sais.get_sa() && doubling.get_sa_lcp() == sais.get_sa_lcp();
+    cout <<name <<" n=" <<text.size()
+         <<" doubling=" <<doubling_ms <<"ms"
+         <<" sais=" <<sais_ms <<"ms"
+         <<(same ? "" : " MISMATCH") <<endl;
+}
+
+inline void run(int n) {
+    mt19937 rng(20240601);
+    vector<char> random = random_text(n, rng);
+    vector<char> periodic = periodic_text(n);
+    vector<char> natural = natural_text(n, rng);
+    compare_modes("random  ", random);
+    compare_modes("periodic", periodic);
+    compare_modes("natural ", natural);
+}
+
+// 1, 2, 4, ... max_threads threads for both modes, checked against the single-threaded build
+inline void run_scaling(int n, int max_threads) {
+    mt19937 rng(20240601);
+    vector<char> text = natural_text(n, rng);
+    using Mode = SuffixArray<char>::Mode;
+    for (Mode mode: {Mode::DOUBLING, Mode::SAIS}) {
+        SuffixArray<char> base(text, mode, 1);
+        double base_ms = 0;
+        for (int t = 1; ; t = min(t * 2, max_threads)) {
+            auto t0 = Clock::now();
+            SuffixArray<char> sa(text, mode, t);
+            double ms = elapsed_ms(t0);
+            if (t == 1) base_ms = ms;
+            bool same = sa.get_sa() == base.get_sa() && sa.get_sa_lcp() == base.get_sa_lcp();
+            cout <<(mode == Mode::SAIS ? "sais    " : "doubling") <<" n=" <<n <<" threads=" <<t
+                 <<" " <<ms <<"ms speedup=" <<base_ms / ms
+                 <<(same ? "" : " MISMATCH") <<endl;
+            if (t == max_threads) break;
+        }
+    }
+}
+
+// find() one by one vs find_batch(), plus random lcp(i, j)
+inline void run_queries(int n, int q) {
+    mt19937 rng(20240601);
+    vector<char> text = natural_text(n, rng);
+    SuffixArray<char> sa(text, SuffixArray<char>::Mode::SAIS);
+
+    uniform_int_distribution<int> pos_dist(0, n - 17), len_dist(4, 16);
+    vector<vector<char>> patterns(q);
+    for (vector<char> &p: patterns) {
+        int pos = pos_dist(rng);
+        p.assign(text.begin() + pos, text.begin() + pos + len_dist(rng));
+    }
+
+    auto t0 = Clock::now();
+    long long total = 0;
+    for (const vector<char> &p: patterns) total += sa.count(p);
+    double single_ms = elapsed_ms(t0);
+
+    t0 = Clock::now();
+    long long batch_total = 0;
+    for (const pair<int, int> &range: sa.find_batch(patterns)) batch_total += range.second - range.first;
+    double batch_ms = elapsed_ms(t0);
+
+    t0 = Clock::now();
+    long long lcp_total = 0;
+    for (int i = 0; i < q; ++i) lcp_total += sa.lcp(pos_dist(rng), pos_dist(rng));
+    double lcp_ms = elapsed_ms(t0);
+
+    cout <<"n=" <<n <<" q=" <<q
+         <<" find=" <<q / single_ms * 1000 <<"/s"
+         <<" find_batch=" <<q / batch_ms * 1000 <<"/s"
+         <<" lcp=" <<q / lcp_ms * 1000 <<"/s"
+         <<(total == batch_total ? "" : " MISMATCH")
+         <<" (" <<total <<" occ, " <<lcp_total <<" lcp)" <<endl;
+}
+
+// memory and count/locate latency of the FM-index against the plain suffix array
+inline void run_fm_index(int n, int q) {
+    mt19937 rng(20240601);
+    vector<char> text = natural_text(n, rng);
+    SuffixArray<char> sa(text, SuffixArray<char>::Mode::SAIS);
+    FMIndex<char> fm(sa);
+
+    uniform_int_distribution<int> pos_dist(0, n - 17), len_dist(4, 16);
+    vector<vector<char>> patterns(q);
+    for (vector<char> &p: patterns) {
+        int pos = pos_dist(rng);
+        p.assign(text.begin() + pos, text.begin() + pos + len_dist(rng));
+    }
+
+    cout <<"n=" <<n
+         <<" sa=" <<sa.memory_usage() / 1048576.0 <<"MB (" <<8.0 * sa.memory_usage() / n <<" bits/symbol)"
+         <<" fm=" <<fm.memory_usage() / 1048576.0 <<"MB (" <<8.0 * fm.memory_usage() / n <<" bits/symbol)" <<endl;
+
+    long long sa_total = 0, fm_total = 0;
+    auto t0 = Clock::now();
+    for (const vector<char> &p: patterns) sa_total += sa.count(p);
+    double sa_ms = elapsed_ms(t0);
+    t0 = Clock::now();
+    for (const vector<char> &p: patterns) fm_total += fm.count(p);
+    double fm_ms = elapsed_ms(t0);
+    cout <<"count  q=" <<q <<" sa=" <<sa_ms * 1e6 / q <<"ns/query fm=" <<fm_ms * 1e6 / q <<"ns/query"
+         <<(sa_total == fm_total ? "" : " MISMATCH") <<endl;
+
+    // locate only on rare patterns, so occurrences do not dominate
+    vector<vector<char>> rare;
+    for (vector<char> &p: patterns) {
+        if (p.size() >= 12 && sa.count(p) <= 8) rare.push_back(p);
+    }
+    sa_total = fm_total = 0;
+    t0 = Clock::now();
+    for (const vector<char> &p: rare) sa_total += sa.locate(p).size();
+    sa_ms = elapsed_ms(t0);
+    t0 = Clock::now();
+    for (const vector<char> &p: rare) fm_total += fm.locate(p).size();
+    fm_ms = elapsed_ms(t0);
+    cout <<"locate q=" <<rare.size() <<" sa=" <<sa_ms * 1e6 / max<size_t>(rare.size(), 1) <<"ns/query fm="
+         <<fm_ms * 1e6 / max<size_t>(rare.size(), 1) <<"ns/query"
+         <<(sa_total == fm_total ? "" : " MISMATCH") <<endl;
+}
+
+// rebuild vs save once + map on restart, with the mapped copy checked against the built one
+inline void run_persistence(int n, const string &path) {
+    mt19937 rng(20240601);
+    vector<char> text = natural_text(n, rng);
+
+    auto t0 = Clock::now();
+    SuffixArray<char> sa(text, SuffixArray<char>::Mode::SAIS);
+    double build_ms = elapsed_ms(t0);
+
+    t0 = Clock::now();
+    sa.save(path);
+    double save_ms = elapsed_ms(t0);
+
+    t0 = Clock::now();
+    MappedSuffixArray<char> mapped(path);
+    double map_ms = elapsed_ms(t0);
+
+    uniform_int_distribution<int> pos_dist(0, n - 17), len_dist(4, 16);
+    bool same = true;
+    for (int q = 0; q < 10000; ++q) {
+        int pos = pos_dist(rng);
+        vector<char> p(text.begin() + pos, text.begin() + pos + len_dist(rng));
+        int i = pos_dist(rng), j = pos_dist(rng);
+        same = same && sa.find(p) == mapped.find(p) && sa.lcp(i, j) == mapped.lcp(i, j);
+    }
+
+    // a header claiming fewer RMQ levels than its size needs has to be rejected, not read past
+    string bad_path = path + ".bad";
+    {
+        ifstream in(path, ios::binary);
+        string bytes((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        ((SuffixArrayFileHeader*)bytes.data())->levels -= 1;
+        ofstream(bad_path, ios::binary | ios::trunc).write(bytes.data(), bytes.size());
+    }
+    bool rejected = false;
+    try {
+        MappedSuffixArray<char> bad(bad_path);
+    } catch (const runtime_error&) {
+        rejected = true;
+    }
+    remove(bad_path.c_str());
+
+    cout <<"n=" <<n <<" build=" <<build_ms <<"ms save=" <<save_ms <<"ms map=" <<map_ms <<"ms"
+         <<(same && rejected ? "" : " MISMATCH") <<endl;
+}
+
+// external build under a small budget, checked against the in-memory one
+inline void run_external(int n, size_t budget, const string &work_dir) {
+    mt19937 rng(20240601);
+    vector<char> text = natural_text(n, rng);
+    string text_path = work_dir + "/sa_text.bin", sa_path = work_dir + "/sa.bin", lcp_path = work_dir + "/sa_lcp.bin";
+    {
+        ofstream out(text_path, ios::binary | ios::trunc);
+        out.write(text.data(), text.size());
+    }
+
+    auto t0 = Clock::now();
+    ExternalSuffixArray(text_path, work_dir, budget).build(sa_path, lcp_path);
+    double external_ms = elapsed_ms(t0);
+
+    t0 = Clock::now();
+    SuffixArray<unsigned char> sa(vector<unsigned char>(text.begin(), text.end()), SuffixArray<unsigned char>::Mode::SAIS);
+    double memory_ms = elapsed_ms(t0);
+
+    MappedArray<uint64_t> ext_sa(sa_path), ext_lcp(lcp_path);
+    bool same = ext_sa.size() == (uint64_t)n && ext_lcp.size() == (uint64_t)n;
+    for (int row = 0; same && row < n; ++row) {
+        same = ext_sa[row] == (uint64_t)sa.get_sa()[row] && ext_lcp[row] == (uint64_t)sa.get_sa_lcp()[row];
+    }
+    cout <<"n=" <<n <<" budget=" <<budget <<"B external=" <<external_ms <<"ms in-memory=" <<memory_ms <<"ms"
+         <<(same ? "" : " MISMATCH") <<endl;
+    remove(text_path.c_str());
+    remove(sa_path.c_str());
+    remove(lcp_path.c_str());
+}
+
+}  // namespace bench
+
+int main(int argc, char **argv) {
+    if (argc > 1 && string(argv[1]) == "bench") {
+        bench::run(argc > 2 ? atoi(argv[2]) : 1 << 20);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "scale") {
+        int max_threads = argc > 3 ? atoi(argv[3]) : max(1u, thread::hardware_concurrency());
+        bench::run_scaling(argc > 2 ? atoi(argv[2]) : 1 << 22, max(1, max_threads));
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "persist") {
+        bench::run_persistence(argc > 2 ? atoi(argv[2]) : 1 << 22, argc > 3 ? argv[3] : "/tmp/suffix_array.bin");
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "external") {
+        bench::run_external(argc > 2 ? atoi(argv[2]) : 1 << 20, argc > 3 ? atoll(argv[3]) : 1 << 20, argc > 4 ? argv[4] : "/tmp");
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "fm") {
+        bench::run_fm_index(argc > 2 ? atoi(argv[2]) : 1 << 22, argc > 3 ? atoi(argv[3]) : 1 << 18);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "query") {
+        bench::run_queries(argc > 2 ? atoi(argv[2]) : 1 << 22, argc > 3 ? atoi(argv[3]) : 1 << 20);
+        return 0;
+    }
+
     vector<char> v = convert("aabaaaab");
     SuffixArray<char> sa(v);
     sa.print();
+
+    SuffixArray<char> sais(v, SuffixArray<char>::Mode::SAIS);
+    sais.print();
+
+    // count("aa") = 4, locate("aa") = 3 4 5 0, lcp(0, 3) = lcp("aabaaaab", "aaaab") = 2
+    cout <<"count(aa) = " <<sa.count(convert("aa")) <<endl;
+    vector<int> occ = sa.locate(convert("aa"));
+    cout <<"locate(aa) = ";
+    copy(occ.begin(), occ.end(), ostream_iterator<int>(std::cout, " "));
+    cout <<endl;
+    cout <<"lcp(0, 3) = " <<sa.lcp(0, 3) <<endl;
+
+    FMIndex<char> fm(sa, 4);
+    occ = fm.locate(convert("aa"));
+    cout <<"fm count(aa) = " <<fm.count(convert("aa")) <<", locate(aa) = ";
+    copy(occ.begin(), occ.end(), ostream_iterator<int>(std::cout, " "));
+    cout <<endl;
+
+    // "ana" is in documents 0 1 2, "band" only in 2, the empty pattern in all of them
+    GeneralizedSuffixArray<char> docs(vector<string>{"banana", "ananas", "bandana"});
+    for (const char *p: {"ana", "band", "nan", ""}) {
+        vector<int> ids = docs.list_documents(convert(p));
+        cout <<"documents(" <<p <<") = ";
+        copy(ids.begin(), ids.end(), ostream_iterator<int>(std::cout, " "));
+        cout <<endl;
+    }
+    // one empty occurrence per position inside a document, 6 + 6 + 7
+    cout <<"count() = " <<docs.count(convert("")) <<endl;
     return 0;
-}
\ No newline at end of file
+}